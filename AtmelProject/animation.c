@@ -0,0 +1,146 @@
+/*
+ * animation.c
+ *
+ * Keyframed animations on the LED matrix - see animation.h
+ */
+
+#include <stdint.h>
+
+#include "animation.h"
+#include "hal.h"
+#include "ledmatrix.h"
+#include "scheduler.h"
+
+// The keyframe being played (in program memory, 0 if no animation is
+// playing), how many of its steps have been done, and the function to
+// run at the end
+static const AnimationKeyframe* keyframe;
+static uint8_t step;
+static TaskFunction done_function;
+static uint8_t done_arg;
+
+// The task which plays the next step
+static TaskId animation_task_id = NO_TASK;
+
+// The palette as it was when the animation started
+static PixelColour saved_palette[LEDMATRIX_PALETTE_SIZE];
+static uint8_t saved_palette_size;
+
+static void animation_task(uint8_t arg);
+
+// Return a colour dimmed to level/steps of its brightness
+static PixelColour dim_colour(PixelColour colour, uint8_t level, uint8_t steps) {
+	uint8_t green = (colour >> 4) * level / steps;
+	uint8_t red = (colour & 0x0F) * level / steps;
+	return (green << 4) | red;
+}
+
+// Set the whole palette to level/steps of its brightness
+static void dim_palette(uint8_t level, uint8_t steps) {
+	PixelColour colours[LEDMATRIX_PALETTE_SIZE];
+	for(uint8_t i = 0; i < saved_palette_size; i++) {
+		colours[i] = dim_colour(saved_palette[i], level, steps);
+	}
+	ledmatrix_set_palette(colours, saved_palette_size);
+}
+
+// Apply the effect of the current keyframe for step number step (0 to
+// steps-1)
+static void apply_effect(uint8_t effect, uint8_t steps, uint8_t arg) {
+	switch(effect) {
+		case ANIMATION_SHIFT_LEFT:
+			ledmatrix_shift_display_left();
+			break;
+		case ANIMATION_SHIFT_RIGHT:
+			ledmatrix_shift_display_right();
+			break;
+		case ANIMATION_SHIFT_UP:
+			ledmatrix_shift_display_up();
+			break;
+		case ANIMATION_SHIFT_DOWN:
+			ledmatrix_shift_display_down();
+			break;
+		case ANIMATION_FLASH:
+			if(arg < saved_palette_size) {
+				ledmatrix_set_palette_colour(arg, (step & 1) ? saved_palette[arg] : COLOUR_BLACK);
+			}
+			break;
+		case ANIMATION_FADE_OUT:
+			dim_palette(steps - 1 - step, steps);
+			break;
+		case ANIMATION_FADE_IN:
+			dim_palette(step + 1, steps);
+			break;
+		case ANIMATION_CLEAR:
+			ledmatrix_clear();
+			break;
+	}
+}
+
+// Put the palette back and forget the animation
+static void end_animation(void) {
+	uint8_t previous_caller = ledmatrix_set_caller(LEDMATRIX_CALLER_TRANSITION);
+	ledmatrix_set_palette(saved_palette, saved_palette_size);
+	ledmatrix_set_caller(previous_caller);
+	keyframe = 0;
+	animation_task_id = NO_TASK;
+}
+
+// Play the next step of the animation, and schedule the step after it
+static void animation_task(uint8_t arg) {
+	uint8_t effect = pgm_read_byte(&keyframe->effect);
+	uint8_t steps = pgm_read_byte(&keyframe->steps);
+	uint16_t interval = pgm_read_byte(&keyframe->interval) * ANIMATION_TICK;
+
+	if(effect == ANIMATION_END) {
+		end_animation();
+		if(done_function) {
+			done_function(done_arg);
+		}
+		return;
+	}
+
+	if(step < steps) {
+		uint8_t previous_caller = ledmatrix_set_caller(LEDMATRIX_CALLER_TRANSITION);
+		apply_effect(effect, steps, pgm_read_byte(&keyframe->arg));
+		ledmatrix_set_caller(previous_caller);
+	}
+	if(++step >= steps) {
+		keyframe++;
+		step = 0;
+	}
+	animation_task_id = scheduler_add_one_shot(PSTR("animation"), animation_task, 0, interval);
+	if(animation_task_id == NO_TASK) {
+		// No room to schedule the rest - skip to the end
+		end_animation();
+		if(done_function) {
+			done_function(done_arg);
+		}
+	}
+}
+
+void animation_play(const AnimationKeyframe* animation, TaskFunction done,
+		uint8_t arg) {
+	animation_stop();
+	saved_palette_size = ledmatrix_get_palette_size();
+	for(uint8_t i = 0; i < saved_palette_size; i++) {
+		saved_palette[i] = ledmatrix_get_palette_colour(i);
+	}
+	keyframe = animation;
+	step = 0;
+	done_function = done;
+	done_arg = arg;
+	// The first step is played straight away
+	animation_task(0);
+}
+
+uint8_t animation_is_playing(void) {
+	return keyframe != 0;
+}
+
+void animation_stop(void) {
+	if(keyframe) {
+		scheduler_remove_task(animation_task_id);
+		end_animation();
+	}
+}
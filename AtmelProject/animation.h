@@ -0,0 +1,59 @@
+/*
+ * animation.h
+ *
+ * Keyframed animations on the LED matrix, such as the level transition
+ * and the death of a frog. An animation is played by the scheduler (see
+ * scheduler.h) one step at a time, so input, the seven segment display
+ * and the other tasks carry on while it plays.
+ *
+ * An animation is an array of keyframes in program memory, ending with
+ * an ANIMATION_END keyframe. Each keyframe applies its effect steps
+ * times, interval * ANIMATION_TICK ms apart (the next keyframe starts one
+ * interval after the last step). The effects act on the whole display
+ * (the shifts) or on the palette (see ledmatrix.h), which is put back as
+ * it was when the animation ends.
+ */
+
+#ifndef ANIMATION_H_
+#define ANIMATION_H_
+
+#include <stdint.h>
+#include "scheduler.h"
+
+#define ANIMATION_TICK 10
+
+typedef struct {
+	uint8_t effect;
+	uint8_t steps;
+	uint8_t interval;	// ANIMATION_TICK ms units
+	uint8_t arg;		// palette entry for ANIMATION_FLASH
+} AnimationKeyframe;
+
+// Effects
+#define ANIMATION_END 0				// the animation is finished
+#define ANIMATION_WAIT 1			// nothing changes
+#define ANIMATION_SHIFT_LEFT 2		// each step shifts the display one
+#define ANIMATION_SHIFT_RIGHT 3		// place - a wipe to blank
+#define ANIMATION_SHIFT_UP 4
+#define ANIMATION_SHIFT_DOWN 5
+#define ANIMATION_FLASH 6			// each step turns palette entry arg off
+									// or back on
+#define ANIMATION_FADE_OUT 7		// the colours fade to black over the
+#define ANIMATION_FADE_IN 8			// steps, or back from black
+#define ANIMATION_CLEAR 9			// the display is cleared
+
+// Start playing an animation (stopping any animation already playing).
+// done is run with the given argument when it has finished (0 for
+// none). While an animation plays, nothing else should draw on the
+// display.
+void animation_play(const AnimationKeyframe* animation, TaskFunction done,
+		uint8_t arg);
+
+// Return 1 if an animation is playing
+uint8_t animation_is_playing(void);
+
+// Stop the animation playing (if any) without running its done function.
+// The palette is put back as it was.
+void animation_stop(void);
+
+#endif /* ANIMATION_H_ */
@@ -0,0 +1,122 @@
+/*
+ * compositor.c
+ *
+ * Layered drawing for the LED matrix - see compositor.h
+ */
+
+#include <stdint.h>
+
+#include "compositor.h"
+#include "ledmatrix.h"
+
+// The draw function of each layer (0 if the layer is empty)
+static LayerDrawFunction layer_draw[COMPOSITOR_NUM_LAYERS];
+
+// Part of each layer which has changed since it was last shown - columns
+// x0 to x_end-1 of rows y0 to y_end-1. It is empty if x0 == x_end (as it
+// is to begin with).
+typedef struct {
+	uint8_t x0;
+	uint8_t y0;
+	uint8_t x_end;
+	uint8_t y_end;
+} DirtyRect;
+static DirtyRect dirty[COMPOSITOR_NUM_LAYERS];
+
+// The layers composited, as last sent to the LED matrix
+static MatrixData frame;
+
+void compositor_set_layer(uint8_t layer, LayerDrawFunction draw) {
+	if(layer < COMPOSITOR_NUM_LAYERS) {
+		layer_draw[layer] = draw;
+		compositor_mark_all_dirty();
+	}
+}
+
+void compositor_mark_dirty(uint8_t layer, uint8_t x, uint8_t y,
+		uint8_t width, uint8_t height) {
+	if(layer >= COMPOSITOR_NUM_LAYERS || x >= MATRIX_NUM_COLUMNS ||
+			y >= MATRIX_NUM_ROWS || !width || !height) {
+		return;
+	}
+	uint8_t x_end = (width > MATRIX_NUM_COLUMNS - x) ? MATRIX_NUM_COLUMNS : x + width;
+	uint8_t y_end = (height > MATRIX_NUM_ROWS - y) ? MATRIX_NUM_ROWS : y + height;
+	DirtyRect* rect = &dirty[layer];
+
+	if(rect->x0 == rect->x_end) {
+		rect->x0 = x;
+		rect->y0 = y;
+		rect->x_end = x_end;
+		rect->y_end = y_end;
+		return;
+	}
+	// Grow the rectangle to take in the new one
+	if(x < rect->x0) {
+		rect->x0 = x;
+	}
+	if(y < rect->y0) {
+		rect->y0 = y;
+	}
+	if(x_end > rect->x_end) {
+		rect->x_end = x_end;
+	}
+	if(y_end > rect->y_end) {
+		rect->y_end = y_end;
+	}
+}
+
+void compositor_mark_all_dirty(void) {
+	compositor_mark_dirty(LAYER_BACKGROUND, 0, 0, MATRIX_NUM_COLUMNS, MATRIX_NUM_ROWS);
+}
+
+void compositor_show(void) {
+	uint8_t first_row = MATRIX_NUM_ROWS;
+	uint8_t last_row = 0;
+
+	for(uint8_t y = 0; y < MATRIX_NUM_ROWS; y++) {
+		// The columns of this row which any layer has changed
+		uint8_t x0 = MATRIX_NUM_COLUMNS;
+		uint8_t x_end = 0;
+		for(uint8_t layer = 0; layer < COMPOSITOR_NUM_LAYERS; layer++) {
+			const DirtyRect* rect = &dirty[layer];
+			if(rect->x0 < rect->x_end && y >= rect->y0 && y < rect->y_end) {
+				if(rect->x0 < x0) {
+					x0 = rect->x0;
+				}
+				if(rect->x_end > x_end) {
+					x_end = rect->x_end;
+				}
+			}
+		}
+		if(x0 >= x_end) {
+			continue;
+		}
+
+		// Draw the whole row, layer by layer, and take the changed
+		// columns into the frame
+		MatrixRow row;
+		set_matrix_row_to_colour(row, 0);
+		for(uint8_t layer = 0; layer < COMPOSITOR_NUM_LAYERS; layer++) {
+			if(layer_draw[layer]) {
+				layer_draw[layer](y, row);
+			}
+		}
+		for(uint8_t x = x0; x < x_end; x++) {
+			SET_MATRIX_PIXEL(frame[y], x, MATRIX_PIXEL(row, x));
+		}
+		if(y < first_row) {
+			first_row = y;
+		}
+		last_row = y;
+	}
+
+	for(uint8_t layer = 0; layer < COMPOSITOR_NUM_LAYERS; layer++) {
+		dirty[layer].x_end = dirty[layer].x0;
+	}
+	// The rows between the changed rows are as the LED matrix shows them,
+	// so sending them costs nothing
+	if(first_row <= last_row) {
+		ledmatrix_update_rows(first_row, last_row - first_row + 1,
+				(const MatrixRow*)&frame[first_row]);
+	}
+}
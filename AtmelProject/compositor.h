@@ -0,0 +1,58 @@
+/*
+ * compositor.h
+ *
+ * Layered drawing for the LED matrix. The display is made up of
+ * COMPOSITOR_NUM_LAYERS layers, drawn from the bottom up - the background
+ * (roadside, road, water and riverbank edges), the traffic, the logs, the
+ * frog and an overlay for effects. A layer doesn't keep any pixels of its
+ * own: it is a function which draws its part of a row over the layers
+ * below it, from the state of the game.
+ *
+ * When part of a layer changes, its owner marks the rectangle which
+ * changed as dirty. compositor_show() redraws the dirty pixels of the
+ * frame (the layers composited) and sends the rows they are in to the LED
+ * matrix, which only sends the pixels that differ from what it shows.
+ * Each layer has its own dirty rectangle, so e.g. a frog move and a lane
+ * scrolling at the same time only recomposite the rows involved rather
+ * than every row between them.
+ *
+ * The frame is what the compositor last sent to the LED matrix. After
+ * anything else has drawn on the display (e.g. ledmatrix_clear() or a
+ * shift), compositor_mark_all_dirty() must be called before the layers
+ * are shown again.
+ */
+
+#ifndef COMPOSITOR_H_
+#define COMPOSITOR_H_
+
+#include <stdint.h>
+#include "ledmatrix.h"
+
+// Layers, from the bottom up
+#define LAYER_BACKGROUND 0
+#define LAYER_TRAFFIC 1
+#define LAYER_LOGS 2
+#define LAYER_FROG 3
+#define LAYER_OVERLAY 4
+#define COMPOSITOR_NUM_LAYERS 5
+
+// Draw the pixels of a layer in row y of the display (0 to
+// MATRIX_NUM_ROWS-1) into row, over the layers below it. Pixels the layer
+// doesn't cover must be left as they are.
+typedef void (*LayerDrawFunction)(uint8_t y, MatrixRow row);
+
+// Set the function which draws a layer (0 for an empty layer). The whole
+// display is marked dirty.
+void compositor_set_layer(uint8_t layer, LayerDrawFunction draw);
+
+// Mark the given rectangle of a layer as changed - columns x to
+// x+width-1 of rows y to y+height-1. The parts off the display are
+// ignored.
+void compositor_mark_dirty(uint8_t layer, uint8_t x, uint8_t y,
+		uint8_t width, uint8_t height);
+void compositor_mark_all_dirty(void);
+
+// Redraw the dirty parts of the layers and send them to the LED matrix
+void compositor_show(void);
+
+#endif /* COMPOSITOR_H_ */
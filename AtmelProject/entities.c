@@ -0,0 +1,226 @@
+/*
+ * entities.c
+ *
+ * Entity pool - see entities.h
+ */
+
+#include <stdint.h>
+
+#include "entities.h"
+#include "ledmatrix.h"
+#include "levels.h"
+#include "playfield.h"
+
+// The entities. The entities of moving row i are row_first[i] to
+// row_first[i+1]-1, so the rows are kept in order.
+static uint8_t entity_start[ENTITY_POOL_SIZE];		// pattern bit of the left
+													// hand end
+static uint8_t entity_length[ENTITY_POOL_SIZE];
+static uint8_t entity_speed[ENTITY_POOL_SIZE];		// multiple of the row speed
+static PaletteIndex entity_colour[ENTITY_POOL_SIZE];
+static uint8_t entity_column[ENTITY_POOL_SIZE];		// column of the left hand end
+													// (0 to width-1 - see
+													// level_span_mask())
+static EntityIndex row_first[NUM_MOVING_ROWS + 1];
+
+// Fastest entity in each row, and the position each row was at when its
+// entities were last updated (ROW_POSITION_UNKNOWN if they need updating)
+static uint8_t row_max_speed[NUM_MOVING_ROWS];
+static uint8_t row_position[NUM_MOVING_ROWS];
+#define ROW_POSITION_UNKNOWN 0xFF
+
+// Level the rows belong to
+static const LevelDescriptor* level_data;
+
+void entities_clear(const LevelDescriptor* level) {
+	level_data = level;
+	for(uint8_t i = 0; i <= NUM_MOVING_ROWS; i++) {
+		row_first[i] = 0;
+	}
+	for(uint8_t i = 0; i < NUM_MOVING_ROWS; i++) {
+		row_max_speed[i] = 1;
+		row_position[i] = ROW_POSITION_UNKNOWN;
+	}
+}
+
+// Return the given bit of a row pattern (as in levels.c)
+static uint8_t pattern_bit(const LevelRow* row, uint8_t bit_position) {
+	return (((const uint8_t*)&row->pattern)[bit_position >> 3] >> (bit_position & 7)) & 1;
+}
+
+// Add an entity for each run of 1 bits in the pattern of the given row.
+// A run may wrap around from the end of the pattern to the start. Returns
+// 0 if they didn't all fit.
+static uint8_t add_runs(uint8_t index) {
+	const LevelRow* row = &level_data->rows[index];
+	uint8_t first_gap = 0;
+	uint8_t length = 0;
+	uint8_t bit;
+
+	// Start at a 0 bit, so we see each run from its start
+	while(first_gap < row->width && pattern_bit(row, first_gap)) {
+		first_gap++;
+	}
+	if(first_gap == row->width) {
+		// No gaps - a single entity the width of the row
+		return entities_add(index, 0, row->width, 1, 
+				ledmatrix_palette_index(row->colour)) != ENTITY_NONE;
+	}
+	bit = first_gap;
+	do {
+		if(++bit == row->width) {
+			bit = 0;
+		}
+		if(pattern_bit(row, bit)) {
+			length++;
+		} else if(length) {
+			if(entities_add(index, bit >= length ? bit - length : bit + row->width - length, 
+					length, 1, ledmatrix_palette_index(row->colour)) == ENTITY_NONE) {
+				return 0;
+			}
+			length = 0;
+		}
+	} while(bit != first_gap);
+	return 1;
+}
+
+// Return the number of runs of 1 bits in the pattern of a row (counted as
+// for add_runs())
+static uint8_t count_runs(const LevelRow* row) {
+	uint64_t all = row->width < 64 ? ((uint64_t)1 << row->width) - 1 : ~(uint64_t)0;
+	uint64_t pattern = row->pattern & all;
+	uint64_t starts;
+	uint8_t runs = 0;
+
+	if(pattern == all) {
+		return 1;
+	}
+	// A run starts at each 1 bit with a 0 bit before it (the bit before 
+	// bit 0 is the last bit)
+	starts = pattern & ~((pattern << 1) | (pattern >> (row->width - 1)));
+	while(starts) {
+		starts &= starts - 1;
+		runs++;
+	}
+	return runs;
+}
+
+uint8_t entities_load(const LevelDescriptor* level) {
+	uint8_t ok = 1;
+	entities_clear(level);
+	for(uint8_t i = 0; i < NUM_MOVING_ROWS && ok; i++) {
+		const LevelRow* row = &level->rows[i];
+		ok = add_runs(i);
+		if(ok && row->fast_length) {
+			ok = (entities_add(i, row->fast_start, row->fast_length, row->fast_speed,
+					ledmatrix_palette_index(row->fast_colour)) != ENTITY_NONE);
+		}
+	}
+	return ok;
+}
+
+uint16_t entities_needed(const LevelDescriptor* level) {
+	uint16_t needed = 0;
+	for(uint8_t i = 0; i < NUM_MOVING_ROWS; i++) {
+		needed += count_runs(&level->rows[i]);
+		if(level->rows[i].fast_length) {
+			needed++;
+		}
+	}
+	return needed;
+}
+
+EntityIndex entities_add(uint8_t index, uint8_t start, uint8_t length,
+		uint8_t speed, PaletteIndex colour) {
+	EntityIndex entity = row_first[index + 1];
+
+	if(row_first[NUM_MOVING_ROWS] == ENTITY_POOL_SIZE) {
+		return ENTITY_NONE;
+	}
+	// Make room at the end of the row. (Entities are usually added in row
+	// order, so there is nothing to move.)
+	for(EntityIndex i = row_first[NUM_MOVING_ROWS]; i > entity; i--) {
+		entity_start[i] = entity_start[i-1];
+		entity_length[i] = entity_length[i-1];
+		entity_speed[i] = entity_speed[i-1];
+		entity_colour[i] = entity_colour[i-1];
+		entity_column[i] = entity_column[i-1];
+	}
+	for(uint8_t i = index + 1; i <= NUM_MOVING_ROWS; i++) {
+		row_first[i]++;
+	}
+
+	entity_start[entity] = start;
+	entity_length[entity] = length;
+	entity_speed[entity] = speed;
+	entity_colour[entity] = colour;
+	entity_column[entity] = start;
+	if(speed > row_max_speed[index]) {
+		row_max_speed[index] = speed;
+	}
+	row_position[index] = ROW_POSITION_UNKNOWN;
+	return entity;
+}
+
+EntityIndex entities_count(void) {
+	return row_first[NUM_MOVING_ROWS];
+}
+
+uint8_t entities_update_row(uint8_t index, uint8_t position, uint32_t phase) {
+	const LevelRow* row = &level_data->rows[index];
+	uint8_t speed = 1;
+	uint8_t speed_position = position;
+	uint8_t scrolled = (position != row_position[index]);
+	uint8_t moved = 0;
+
+	row_position[index] = position;
+	for(EntityIndex i = row_first[index]; i < row_first[index + 1]; i++) {
+		// Entities at the speed of the row only move when it scrolls
+		if(entity_speed[i] == 1 && !scrolled) {
+			continue;
+		}
+		// Entities of the same speed are at the same position
+		if(entity_speed[i] != speed) {
+			speed = entity_speed[i];
+			speed_position = level_row_position_at_speed(row, position, phase, speed);
+		}
+		// Pattern bit start is shown speed_position columns to the left
+		// of it
+		uint8_t column = entity_start[i] + row->width - speed_position;
+		if(column >= row->width) {
+			column -= row->width;
+		}
+		if(column != entity_column[i]) {
+			entity_column[i] = column;
+			moved = 1;
+		}
+	}
+	return moved;
+}
+
+uint8_t entities_row_has_fast(uint8_t index) {
+	return row_max_speed[index] > 1;
+}
+
+RowMask entities_row_mask(uint8_t index) {
+	uint8_t width = level_data->rows[index].width;
+	RowMask mask = 0;
+	for(EntityIndex i = row_first[index]; i < row_first[index + 1]; i++) {
+		mask |= level_span_mask(entity_column[i], entity_length[i], width);
+	}
+	return mask;
+}
+
+void entities_draw_row(uint8_t index, MatrixRow matrix_row) {
+	uint8_t width = level_data->rows[index].width;
+	for(EntityIndex i = row_first[index]; i < row_first[index + 1]; i++) {
+		// Only the columns on the board are drawn
+		RowMask mask = level_span_mask(entity_column[i], entity_length[i], width) & ROW_MASK_ALL;
+		for(uint8_t column = 0; mask && column < MATRIX_NUM_COLUMNS; column++) {
+			if(mask & 1) {
+				SET_MATRIX_PIXEL(matrix_row, column, entity_colour[i]);
+			}
+			mask >>= 1;
+		}
+	}
+}
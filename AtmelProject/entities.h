@@ -0,0 +1,100 @@
+/*
+ * entities.h
+ *
+ * Entity pool - the vehicles and logs of the current level. Each entity
+ * is a run of columns in one of the moving rows (see playfield.h) with
+ * its own length, speed and colour. The row masks the game uses for
+ * collisions, and the rows it draws, are rasterised from the entities of
+ * the row whenever any of them moves.
+ *
+ * Entities don't keep their own clocks. An entity moves speed times as
+ * far as its row (see advance_moving_rows() in game.h), so where it is
+ * follows from the position and phase of its row. A speed of 1 is the
+ * row's own pattern; faster vehicles overtake the rest of the lane.
+ *
+ * The pool is a structure of arrays - one array per field - with the
+ * entities of each row kept together, so a pass over the entities of a
+ * row only touches the fields it needs. The pool is a fixed size:
+ * ENTITY_POOL_SIZE entities at 5 bytes each.
+ */
+
+#ifndef ENTITIES_H_
+#define ENTITIES_H_
+
+#include <stdint.h>
+#include "ledmatrix.h"
+#include "levels.h"
+#include "playfield.h"
+
+// Most entities a level may have. The generated levels are kept within
+// this on every platform, so that a seed gives the same levels on the
+// host as on the AVR.
+#define LEVEL_MAX_ENTITIES 64
+
+#ifndef ENTITY_POOL_SIZE
+#ifdef __AVR__
+#define ENTITY_POOL_SIZE LEVEL_MAX_ENTITIES
+#else
+#define ENTITY_POOL_SIZE 4096
+#endif
+#endif
+
+#if ENTITY_POOL_SIZE < LEVEL_MAX_ENTITIES
+#error "ENTITY_POOL_SIZE must hold the entities of a level"
+#endif
+
+// Index of an entity in the pool - the smallest type which will do
+#if ENTITY_POOL_SIZE < 256
+typedef uint8_t EntityIndex;
+#else
+typedef uint16_t EntityIndex;
+#endif
+
+// Returned by entities_add() if the pool is full
+#define ENTITY_NONE ((EntityIndex)~(EntityIndex)0)
+
+// Empty the pool. The rows (widths and directions) are those of the given
+// level descriptor, which must stay valid while the pool is used.
+void entities_clear(const LevelDescriptor* level);
+
+// Empty the pool and fill it with the entities of the given level - one
+// for each run of 1 bits in each row pattern, in the row colour, and the
+// fast vehicle of each row (if any). The colours are looked up in the 
+// palette of the LED matrix (see ledmatrix_palette_index()). Returns 0 if
+// they didn't all fit.
+uint8_t entities_load(const LevelDescriptor* level);
+
+// Return the number of entities entities_load() needs for the given level
+uint16_t entities_needed(const LevelDescriptor* level);
+
+// Add an entity to the given moving row (0 to NUM_MOVING_ROWS-1). start
+// is the pattern bit its left hand end is at (as for a 1 bit of the row
+// pattern), speed is a multiple of the row speed and colour is an entry
+// of the LED matrix palette. Returns the index of the entity (which is 
+// only valid until the next entity is added) or ENTITY_NONE if the pool 
+// is full.
+EntityIndex entities_add(uint8_t index, uint8_t start, uint8_t length,
+		uint8_t speed, PaletteIndex colour);
+
+// Return the number of entities in the pool
+EntityIndex entities_count(void);
+
+// Work out where the entities of the given moving row are, with the row
+// at the given position (see get_moving_row_position() in game.h) and
+// phase. Returns 1 if any of them has moved since the last update.
+uint8_t entities_update_row(uint8_t index, uint8_t position, uint32_t phase);
+
+// Return 1 if the given moving row has entities moving faster than the
+// row (which move between the scrolls of the row)
+uint8_t entities_row_has_fast(uint8_t index);
+
+// Return the columns of the given moving row covered by its entities
+// (as of the last entities_update_row())
+RowMask entities_row_mask(uint8_t index);
+
+// Draw the entities of the given moving row (as of the last
+// entities_update_row()) into a row of the LED matrix. The columns
+// between them are left as they are.
+void entities_draw_row(uint8_t index, MatrixRow matrix_row);
+
+#endif /* ENTITIES_H_ */
@@ -5,18 +5,22 @@
  */ 
 
 #include "game.h"
+#include "compositor.h"
+#include "entities.h"
+#include "hal.h"
 #include "ledmatrix.h"
+#include "levels.h"
+#include "playfield.h"
 #include "pixel_colour.h"
 #include "score.h"
 #include "terminalio.h"
-#include <avr/io.h>
-#include <avr/pgmspace.h>
 #include <stdint.h>
 #include <stdio.h>
 
 ///////////////////////////////// Global variables //////////////////////
 // frog_row and frog_column store the current position of the frog. Row 
-// numbers are from 0 to 7; column numbers are from 0 to 15. 
+// numbers are from 0 to RIVERBANK_ROW; column numbers are from 0 to 
+// LAST_COLUMN (see playfield.h). 
 static int8_t frog_row;
 static int8_t frog_column;
 // Maximum (largest) row the frog has reached in this life
@@ -33,117 +37,78 @@ static int8_t level;
 // Boolean flag to indicate whether the frog is alive or dead
 static uint8_t frog_dead;
 
-// Vehicle data - 64 bits in each lane which we loop continuously. A 1
-// indicates the presence of a vehicle, 0 is empty.
-// Index 0 to 2 corresponds to lanes 1 to 3 respectively. Lanes 1 and 3
-// will move to the right; lane 2 will move to the left.
-#define LANE_DATA_WIDTH 64	// must be power of 2
-static uint64_t lane_data[3][3] = {
-		// Level pattern A
-		{
-			0b1100001100011000110000011001100011000011000110001100000110011000,
-			0b0011100000111000011100000111000011100001110001110000111000011100,
-			0b0000111100001111000011110000111100001111000001111100001111000111
-		},
-		// Level pattern B
-		{
-			0b0001000110000011001100010000011000100000010000011000110000100010,
-			0b1110000001110000001110000001110000001110000001110000001110000001,
-			0b0011110001110001111000110000111000011110000110000111001111000011
-		},
-		// Level pattern C
-		{
-			0b1111100011111000001111100001111100000011111000111110001111100000,
-			0b0001110001110001110001110001110001110001110001110001110001110000,
-			0b0011000001100011000011001100001100011000001100011001100110000110
-		}
-};
-		
-// Log data - 32 bits for each log channel which we loop continuously.
-// A 1 indicates the presence of a log, 0 is empty.
-// Index 0 to 1 corresponds to rows 5 and 6 respectively. Row 5 will move
-// to the left; row 6 will move to the right
-#define LOG_DATA_WIDTH 32 // must be power of 2
-static uint32_t log_data[3][2] = {
-	// Level pattern A
-	{
-		0b11110001100111000111100011111000,
-		0b11100110111101100001110110011100
-	},
-	// Level pattern B
-	{
-		0b00111000011110011100011000011110,
-		0b11100011011100001110001100111100
-	},
-	// Level pattern C
-	{
-		0b00111001111000001110000110000111,
-		0b11000011110000111000000011100011
-	}
-};
-
-// Lane positions. The bit position (0 to 63) of the lane_data above that is
-// currently in column 0 of the display (left hand side). (Bit position
+// Descriptor of the current level (copied from program memory by
+// set_level()) - see levels.h
+static LevelDescriptor level_data;
+
+// Seed from which the levels after the built-in ones are generated
+static uint32_t level_seed;
+
+// Lane positions. The bit position (0 to width-1) of the lane pattern that
+// is currently in column 0 of the display (left hand side). (Bit position
 // 0 is the least significant bit.) For a lane position of N, the display
-// will show bits N to N+15 from left to right (wrapping around if N+15 
-// exceeds 63). 
-static int8_t lane_position[3];
+// will show bits N to N+LAST_COLUMN from left to right (wrapping around if
+// N+LAST_COLUMN exceeds the width of the pattern). 
+static int8_t lane_position[NUM_LANES];
 
 // Log positions. Same principle as lane positions.
-static int8_t log_position[2];
+static int8_t log_position[NUM_CHANNELS];
+
+// Death masks - one for each row of the display. Bit N is set if the frog
+// would die in column N of that row (a vehicle, water between the logs or
+// an edge/occupied hole in the riverbank). These are built by
+// initialise_game() and rasterised from the vehicles and logs (see 
+// entities.h) each time they move, so collision checks don't need to 
+// look at the entities.
+static RowMask death_mask[BOARD_NUM_ROWS];
+
+// Number of collision checks made (see get_collision_checks())
+static uint32_t collision_checks;
+
+// Speed of each moving row at the current level (worked out by 
+// set_level()) and how far (32 bit fraction of a column) each has moved
+// since it last scrolled. See advance_moving_rows().
+static RowVelocity row_velocity[NUM_MOVING_ROWS];
+static uint32_t row_phase[NUM_MOVING_ROWS];
 
 // Colours
 #define COLOUR_FROG			COLOUR_GREEN
 #define COLOUR_DEAD_FROG	COLOUR_LIGHT_YELLOW
 #define COLOUR_EDGES		COLOUR_LIGHT_GREEN
-#define COLOUR_WATER		COLOUR_BLACK
-#define COLOUR_ROAD			COLOUR_BLACK
-PixelColour log_colours[3] = {
-	COLOUR_ORANGE, // Level pattern A
-	COLOUR_RED, // Level pattern B
-	COLOUR_YELLOW // Level pattern C
-};
-PixelColour vehicle_colours[3][3] = { // by lane
-	{ COLOUR_RED, COLOUR_YELLOW, COLOUR_RED }, // Level pattern A
-	{ COLOUR_LIGHT_YELLOW, COLOUR_ORANGE, COLOUR_LIGHT_YELLOW }, // Level pattern B
-	{ COLOUR_LIGHT_ORANGE, COLOUR_RED, COLOUR_LIGHT_ORANGE } // Level pattern C
-};
-
-// Rows
-#define START_ROW 0	// row position where the frog starts
-#define FIRST_VEHICLE_ROW 1
-#define SECOND_VEHICLE_ROW 2
-#define THIRD_VEHICLE_ROW 3
-#define HALFWAY_ROW 4 // row position where the frog can rest
-#define FIRST_RIVER_ROW 5
-#define SECOND_RIVER_ROW 6
-#define RIVERBANK_ROW 7 // row position where the frog finishes
-
-// River bank pattern. Note that the least significant bit in this
-// pattern (RHS) corresponds to column 0 on the display (LHS).
-#define RIVERBANK_A 0b1101110111011101
-#define RIVERBANK_B 0b1011101101111011
-#define RIVERBANK_C 0b1010111111110101
-static uint16_t riverbank;
+
+// Palette entries of the road and water (the rest are in game.h - see
+// set_level_palette())
+#define PALETTE_WATER		PALETTE_BLACK
+#define PALETTE_ROAD		PALETTE_BLACK
+
+// River bank pattern of the current level. Note that the least significant
+// bit in this pattern (RHS) corresponds to column 0 on the display (LHS).
+static RowMask riverbank;
 // riverbank_status is a bit pattern similar to riverbank but will
 // only have zeroes where there are unoccupied holes. When this is all 1's
 // then the game/level is complete
-static uint16_t riverbank_status;
+static RowMask riverbank_status;
+
+// How many display batches are open (see begin_display_batch())
+static uint8_t display_batch_depth;
 
 
 /////////////////////////////// Function Prototypes for Helper Functions ///////
 // These functions are defined after the public functions. Comments are with the
 // definitions.
-static uint16_t get_level_riverbank(void);
-static PixelColour get_log_colour(void);
-static PixelColour get_vehicle_colour(uint8_t lane_index);
-static uint8_t get_level_data_index(void);
+static void set_level_palette(void);
+static void build_death_masks(void);
+static uint8_t update_moving_row(uint8_t index);
+static void move_fast_vehicles(uint8_t lane);
 static uint8_t will_frog_die_at_position(int8_t row, int8_t column);
 static void redraw_whole_display(void);
-static void redraw_row(uint8_t row);
-static void redraw_traffic_lane(uint8_t lane);
-static void redraw_river_channel(uint8_t channel);
+static void redraw_moving_row(uint8_t index);
 static void redraw_frog(void);
+static void show_changes(void);
+static void draw_background(uint8_t y, MatrixRow matrix_row);
+static void draw_traffic(uint8_t y, MatrixRow matrix_row);
+static void draw_logs(uint8_t y, MatrixRow matrix_row);
+static void draw_frog(uint8_t y, MatrixRow matrix_row);
 		
 /////////////////////////////// Public Functions ///////////////////////////////
 // These functions are defined in the same order as declared in game.h
@@ -151,12 +116,21 @@ static void redraw_frog(void);
 // Reset the game
 void initialise_game(void) {
 	// Initial lane and log positions
-	lane_position[0] = lane_position[1] = lane_position[2] = 0;
-	log_position[0] = log_position[1] = 0;
+	for(uint8_t lane=0; lane<NUM_LANES; lane++) {
+		lane_position[lane] = 0;
+	}
+	for(uint8_t channel=0; channel<NUM_CHANNELS; channel++) {
+		log_position[channel] = 0;
+	}
+	for(uint8_t i = 0; i < NUM_MOVING_ROWS; i++) {
+		row_phase[i] = 0;
+	}
 	
 	// Initial riverbank pattern
-	riverbank = get_level_riverbank();
-	riverbank_status = get_level_riverbank();
+	riverbank = level_data.riverbank;
+	riverbank_status = level_data.riverbank;
+	
+	build_death_masks();
 	
 	redraw_whole_display();
 	
@@ -166,25 +140,35 @@ void initialise_game(void) {
 
 // Add a frog to the game
 void put_frog_in_start_position(void) {
-	// Initial starting position of frog (7,0)
-	frog_row = 0;
-	frog_column = 7;
+	// Remove the frog from where it was
+	redraw_frog();
+	
+	// Initial starting position of frog - the middle of the bottom row
+	frog_row = START_ROW;
+	frog_column = FROG_START_COLUMN;
 	
 	// Frog starts at the bottom row
-	frog_max_row = 0;
+	frog_max_row = START_ROW;
 	
 	// Frog is initially alive
 	frog_dead = 0;
 	
 	// Show the frog
 	redraw_frog();
+	show_changes();
+}
+
+void kill_frog(void) {
+	frog_dead = 1;
+	redraw_frog();
+	show_changes();
 }
 
-// This function assumes that the frog is not in row 7 (the top row). A frog in row 7 is out
-// of the game.
+// This function assumes that the frog is not in the riverbank row (the top row). A frog 
+// there is out of the game.
 void move_frog_forward(void) {
-	// Redraw the row the frog is currently on (this will remove the frog)
-	redraw_row(frog_row);
+	// Remove the frog from where it is now
+	redraw_frog();
 	
 	// Check whether this move will cause the frog to die or not
 	frog_dead = will_frog_die_at_position(frog_row+1, frog_column);
@@ -204,28 +188,31 @@ void move_frog_forward(void) {
 	
 	// If the frog has ended up successfully in row 7 - add it to the riverbank_status flag
 	if(!frog_dead && frog_row == RIVERBANK_ROW) {
-		riverbank_status |= (1<<frog_column);
+		riverbank_status |= COLUMN_BIT(frog_column);
+		death_mask[RIVERBANK_ROW] = riverbank_status;
 	}
+	show_changes();
 }
 
 void move_frog_backward(void) {
-	// Redraw the row the frog is currently on
-	redraw_row(frog_row);
+	// Remove the frog from where it is now
+	redraw_frog();
 	
 	// Check whether this move will cause the frog to die or not
 	frog_dead = will_frog_die_at_position(frog_row-1, frog_column);
 	
 	// If the frog isn't in the bottom row, move the frog position backward
-	if (frog_row != 0) {
+	if (frog_row != START_ROW) {
 		frog_row--;
 	}
 	// Show the frog
 	redraw_frog();
+	show_changes();
 }
 
 void move_frog_to_left(void) {
-	// Redraw the row the frog is currently on
-	redraw_row(frog_row);
+	// Remove the frog from where it is now
+	redraw_frog();
 	
 	// Check whether this move will cause the frog to die or not
 	frog_dead = will_frog_die_at_position(frog_row, frog_column-1);
@@ -237,29 +224,31 @@ void move_frog_to_left(void) {
 	}
 	// Show the frog
 	redraw_frog();
+	show_changes();
 }
 
 void move_frog_to_right(void) {
-	// Redraw the row the frog is currently on
-	redraw_row(frog_row);
+	// Remove the frog from where it is now
+	redraw_frog();
 	
 	// Check whether this move will cause the frog to die or not
 	frog_dead = will_frog_die_at_position(frog_row, frog_column+1);
 	
 	// If the frog isn't currently in the rightmost column, move the frog right
-	if (frog_column != 15) {
+	if (frog_column != LAST_COLUMN) {
 		// Move the frog position right
 		frog_column++;
 	}
 	// Show the frog
 	redraw_frog();
+	show_changes();
 }
 
-// This function assumes that the frog is not in row 7 (the top row). A frog in row 7 is out
-// of the game.
+// This function assumes that the frog is not in the riverbank row (the top row). A frog 
+// there is out of the game.
 void move_frog_up_right(void) {
-	// Redraw the row the frog is currently on (this will remove the frog)
-	redraw_row(frog_row);
+	// Remove the frog from where it is now
+	redraw_frog();
 	
 	// Check whether this move will cause the frog to die or not
 	frog_dead = will_frog_die_at_position(frog_row+1, frog_column+1);
@@ -280,15 +269,17 @@ void move_frog_up_right(void) {
 	
 	// If the frog has ended up successfully in row 7 - add it to the riverbank_status flag
 	if(!frog_dead && frog_row == RIVERBANK_ROW) {
-		riverbank_status |= (1<<frog_column);
+		riverbank_status |= COLUMN_BIT(frog_column);
+		death_mask[RIVERBANK_ROW] = riverbank_status;
 	}
+	show_changes();
 }
 
-// This function assumes that the frog is not in row 7 (the top row). A frog in row 7 is out
-// of the game.
+// This function assumes that the frog is not in the riverbank row (the top row). A frog 
+// there is out of the game.
 void move_frog_up_left(void) {
-	// Redraw the row the frog is currently on (this will remove the frog)
-	redraw_row(frog_row);
+	// Remove the frog from where it is now
+	redraw_frog();
 	
 	// Check whether this move will cause the frog to die or not
 	frog_dead = will_frog_die_at_position(frog_row+1, frog_column-1);
@@ -309,42 +300,46 @@ void move_frog_up_left(void) {
 	
 	// If the frog has ended up successfully in row 7 - add it to the riverbank_status flag
 	if(!frog_dead && frog_row == RIVERBANK_ROW) {
-		riverbank_status |= (1<<frog_column);
+		riverbank_status |= COLUMN_BIT(frog_column);
+		death_mask[RIVERBANK_ROW] = riverbank_status;
 	}
+	show_changes();
 }
 
 void move_frog_down_right(void) {
-	// Redraw the row the frog is currently on
-	redraw_row(frog_row);
+	// Remove the frog from where it is now
+	redraw_frog();
 	
 	// Check whether this move will cause the frog to die or not
 	frog_dead = will_frog_die_at_position(frog_row-1, frog_column+1);
 	
 	// If the frog isn't in the bottom row or the rightmost column,
 	// move the frog position backward and to the right
-	if (frog_row != 0 && frog_column != 15) {
+	if (frog_row != START_ROW && frog_column != LAST_COLUMN) {
 		frog_row--;
 		frog_column++;
 	}
 	// Show the frog
 	redraw_frog();
+	show_changes();
 }
 
 void move_frog_down_left(void) {
-	// Redraw the row the frog is currently on
-	redraw_row(frog_row);
+	// Remove the frog from where it is now
+	redraw_frog();
 	
 	// Check whether this move will cause the frog to die or not
 	frog_dead = will_frog_die_at_position(frog_row-1, frog_column-1);
 	
 	// If the frog isn't in the bottom row or the leftmost column,
 	// move the frog position backward and to the left
-	if (frog_row != 0 && frog_column != 0) {
+	if (frog_row != START_ROW && frog_column != 0) {
 		frog_row--;
 		frog_column--;
 	}
 	// Show the frog
 	redraw_frog();
+	show_changes();
 }
 
 uint8_t get_frog_row(void) {
@@ -356,7 +351,7 @@ uint8_t get_frog_column(void) {
 }
 
 uint8_t is_riverbank_full(void) {
-	return (riverbank_status == 0xFFFF);
+	return (riverbank_status == ROW_MASK_ALL);
 }
 
 uint8_t frog_has_reached_riverbank(void) {
@@ -378,12 +373,8 @@ void init_lives(void) {
 void set_lives(uint8_t new_num_lives) {
 	// Ensure we don't set lives greater than the maximum
 	num_lives = new_num_lives > MAX_LIVES ? MAX_LIVES : new_num_lives;
-	// Clear Port A
-	PORTA = 0;
-	// LEDs for lives use upper 4 bits of Port A
-	for (int8_t i = 0; i < num_lives; ++i) {
-		PORTA |= (1<<(i+4));
-	}
+	// Show the number of lives on the lives LEDs
+	hal_show_lives(num_lives);
 }
 
 uint8_t get_level(void) {
@@ -394,13 +385,30 @@ void init_level(void) {
 	set_level(1);
 }
 
+void set_level_seed(uint32_t seed) {
+	level_seed = seed;
+}
+
+uint32_t get_level_seed(void) {
+	return level_seed;
+}
+
 void set_level(uint8_t new_level) {
 	level = new_level;
+	load_level_descriptor(level, level_seed, &level_data);
+	set_level_palette();
+	entities_load(&level_data);
+	
+	// Rows speed up with the level
+	for(uint8_t i = 0; i < NUM_MOVING_ROWS; i++) {
+		row_velocity[i] = level_row_velocity(&level_data.rows[i], level);
+	}
+	
 	move_cursor(1, 2);
 	printf_P(PSTR("Level: %4d"), level);
 }
 
-// Scroll the given lane of traffic. (lane value must be 0 to 2)
+// Scroll the given lane of traffic. (lane value must be 0 to NUM_LANES-1)
 void scroll_vehicle_lane(uint8_t lane, int8_t direction) {
 	uint8_t frog_is_in_this_row = (frog_row == lane + FIRST_VEHICLE_ROW);
 	
@@ -408,15 +416,19 @@ void scroll_vehicle_lane(uint8_t lane, int8_t direction) {
 	// Wrap numbers around if they go out of range
 	// A direction of -1 indicates movement to the left which means we
 	// start from a higher bit position in column 0
+	const LevelRow* lane_data = &level_data.rows[lane];
 	lane_position[lane] -= direction;
 	if(lane_position[lane] < 0) {
-		lane_position[lane] = LANE_DATA_WIDTH-1;
-	} else if(lane_position[lane] >= LANE_DATA_WIDTH) {
+		lane_position[lane] = lane_data->width-1;
+	} else if(lane_position[lane] >= lane_data->width) {
 		lane_position[lane] = 0;
 	}
 	
+	// Move the vehicles
+	update_moving_row(lane);
+	
 	// Show the lane on the display
-	redraw_traffic_lane(lane);
+	redraw_moving_row(lane);
 	
 	// If the frog is in this row, check whether it is dead or
 	// not (may have been hit by a vehicle) and show it
@@ -424,6 +436,7 @@ void scroll_vehicle_lane(uint8_t lane, int8_t direction) {
 		frog_dead = will_frog_die_at_position(frog_row, frog_column);
 		redraw_frog();
 	}
+	show_changes();
 }
 
 
@@ -432,9 +445,11 @@ void scroll_river_channel(uint8_t channel, int8_t direction) {
 	// Note, if the frog is in this row then it will be on a log
 	
 	if(frog_is_in_this_row) {
+		// Remove the frog from where it is now
+		redraw_frog();
 		// Check if they're going to hit the edge - don't let the frog
 		// go beyond the edge
-		if(direction == 1 && frog_column == 15) {
+		if(direction == 1 && frog_column == LAST_COLUMN) {
 			frog_dead = 1; // hit right edge
 		} else if(direction == -1 && frog_column == 0) {
 			frog_dead = 1; // hit left edge
@@ -446,48 +461,157 @@ void scroll_river_channel(uint8_t channel, int8_t direction) {
 		
 	// Work out the new log position.
 	// Wrap numbers around if they go out of range
+	const LevelRow* log_data = &level_data.rows[channel+FIRST_CHANNEL_INDEX];
 	log_position[channel] -= direction;
 	if(log_position[channel] < 0) {
-		log_position[channel] = LOG_DATA_WIDTH-1;
-	} else if(log_position[channel] >= LOG_DATA_WIDTH) {
+		log_position[channel] = log_data->width-1;
+	} else if(log_position[channel] >= log_data->width) {
 		log_position[channel] = 0;
 	}
 		
-	// Work out the log data to send to the display
-	redraw_river_channel(channel);
+	// Move the logs
+	update_moving_row(channel+FIRST_CHANNEL_INDEX);
+		
+	// Show the channel on the display
+	redraw_moving_row(channel+FIRST_CHANNEL_INDEX);
 		
 	// If the frog is in this row, put them on the log
 	if(frog_is_in_this_row) {
 		redraw_frog();
 	}
+	show_changes();
 }
 
-/////////////////////////////// Private (Helper) Functions /////////////////////
+uint32_t get_collision_checks(void) {
+	return collision_checks;
+}
+
+void reset_collision_checks(void) {
+	collision_checks = 0;
+}
 
-static uint8_t get_level_data_index(void) {
-	return (level - 1) % 3; // 3 unique level patterns, index can be 0, 1 or 2
+RowVelocity get_moving_row_velocity(uint8_t index) {
+	return row_velocity[index];
 }
 
-static uint16_t get_level_riverbank(void) {
-	switch (get_level_data_index()) {
-	case 0:
-		return RIVERBANK_A;
-	case 1:
-		return RIVERBANK_B;
-	case 2:
-		return RIVERBANK_C;
-	default:
-		return RIVERBANK_A;
+uint32_t get_moving_row_phase(uint8_t index) {
+	return row_phase[index];
+}
+
+void advance_moving_rows(uint16_t ms) {
+	// Each ms, every row moves on by its velocity. A row scrolls when its
+	// phase carries into a whole column. The rows which scroll are sent to
+	// the LED matrix together at the end.
+	begin_display_batch();
+	while(ms-- && !frog_dead) {
+		for(uint8_t i = 0; i < NUM_MOVING_ROWS && !frog_dead; i++) {
+			row_phase[i] += row_velocity[i];
+			if(row_phase[i] < row_velocity[i]) {
+				scroll_moving_row(i);
+			} else if(i < FIRST_CHANNEL_INDEX && entities_row_has_fast(i)) {
+				move_fast_vehicles(i);
+			}
+		}
 	}
+	end_display_batch();
+}
+
+void begin_display_batch(void) {
+	display_batch_depth++;
 }
 
-// Log colour depends on current level
-static PixelColour get_log_colour(void) {
-	return log_colours[get_level_data_index()];
+void end_display_batch(void) {
+	if(display_batch_depth) {
+		display_batch_depth--;
+	}
+	show_changes();
 }
 
-static PixelColour get_vehicle_colour(uint8_t lane_index) {
-	return vehicle_colours[get_level_data_index()][lane_index];
+void scroll_moving_row(uint8_t index) {
+	if(index < FIRST_CHANNEL_INDEX) {
+		scroll_vehicle_lane(index, level_data.rows[index].direction);
+	} else {
+		scroll_river_channel(index - FIRST_CHANNEL_INDEX, level_data.rows[index].direction);
+	}
+}
+
+uint8_t get_moving_row_position(uint8_t index) {
+	if(index < FIRST_CHANNEL_INDEX) {
+		return lane_position[index];
+	} else {
+		return log_position[index - FIRST_CHANNEL_INDEX];
+	}
+}
+
+RowMask get_riverbank_status(void) {
+	return riverbank_status;
+}
+
+const LevelDescriptor* get_level_descriptor(void) {
+	return &level_data;
+}
+
+/////////////////////////////// Private (Helper) Functions /////////////////////
+
+// Give the LED matrix the palette of the current level - the fixed
+// entries, then each colour of its vehicles and logs (see levelgen.c)
+// once. The entities look their colours up in it (see entities_load()).
+static void set_level_palette(void) {
+	PixelColour colours[LEDMATRIX_PALETTE_SIZE] =
+			{ COLOUR_BLACK, COLOUR_FROG, COLOUR_DEAD_FROG, COLOUR_EDGES };
+	uint8_t num_colours = PALETTE_FIRST_LEVEL_COLOUR;
+
+	for(uint8_t i = 0; i < 2 * NUM_MOVING_ROWS; i++) {
+		const LevelRow* row = &level_data.rows[i / 2];
+		PixelColour colour = (i & 1) ? row->fast_colour : row->colour;
+		uint8_t j = 0;
+		if((i & 1) && !row->fast_length) {
+			continue;
+		}
+		while(j < num_colours && colours[j] != colour) {
+			j++;
+		}
+		if(j == num_colours && num_colours < LEDMATRIX_PALETTE_SIZE) {
+			colours[num_colours++] = colour;
+		}
+	}
+	ledmatrix_set_palette(colours, num_colours);
+}
+
+// Build the death masks for every row from the current lane and log 
+// positions and riverbank status.
+static void build_death_masks(void) {
+	death_mask[START_ROW] = 0;
+	death_mask[HALFWAY_ROW] = 0;
+	for(uint8_t i = 0; i < NUM_MOVING_ROWS; i++) {
+		update_moving_row(i);
+	}
+	death_mask[RIVERBANK_ROW] = riverbank_status;
+}
+
+// Work out where the vehicles or logs of a moving row are and rasterise 
+// them into the death mask of the row - vehicles in a lane, the water 
+// between the logs in a channel. Returns 1 if any of them moved.
+static uint8_t update_moving_row(uint8_t index) {
+	uint8_t moved = entities_update_row(index, get_moving_row_position(index),
+			row_phase[index]);
+	RowMask mask = entities_row_mask(index);
+	if(index >= FIRST_CHANNEL_INDEX) {
+		mask = ~mask & ROW_MASK_ALL;
+	}
+	death_mask[MOVING_ROW(index)] = mask;
+	return moved;
+}
+
+// Move the fast vehicles of a lane on between the scrolls of the lane. 
+// They may hit the frog.
+static void move_fast_vehicles(uint8_t lane) {
+	if(update_moving_row(lane)) {
+		redraw_moving_row(lane);
+		if(frog_row == lane + FIRST_VEHICLE_ROW) {
+			frog_dead = will_frog_die_at_position(frog_row, frog_column);
+		}
+	}
 }
 
 // Return 1 if the frog will die at the given position. 
@@ -495,168 +619,96 @@ static PixelColour get_vehicle_colour(uint8_t lane_index) {
 // a vehicle), or, if in the river, then it IS occupied by a log, or, if the final
 // riverbank then that space is free.
 static uint8_t will_frog_die_at_position(int8_t row, int8_t column) {
-	uint8_t lane, channel, bit_position;
-	if(column < 0 || column > 15) {
+	collision_checks++;
+	// Any position outside the game field means the frog will die
+	if(row < 0 || row > RIVERBANK_ROW || column < 0 || column > LAST_COLUMN) {
 		return 1;
 	}
-	switch(row) {
-		case 0: // always safe
-		case 4: // always safe
-			return 0;
-			break;
-		case 1:
-		case 2:
-		case 3:
-			lane = row - 1;
-			bit_position = lane_position[lane] + column;
-			if(bit_position >= LANE_DATA_WIDTH) {
-				bit_position -= LANE_DATA_WIDTH;
-			}
-			return (lane_data[get_level_data_index()][lane] >> bit_position) & 1;
-			break;
-		case 5:
-		case 6:
-			channel = row - 5;
-			bit_position = log_position[channel] + column;
-			if(bit_position >= LOG_DATA_WIDTH) {
-				bit_position -= LOG_DATA_WIDTH;
-			}
-			return !((log_data[get_level_data_index()][channel] >> bit_position) & 1);
-			break;
-		case 7:
-			return (riverbank_status >> column) & 1;
-			break;	
-	}
-	// Any row outside the valid range means the frog will die
-	return 1;	
+	return (death_mask[row] >> column) & 1;
 }
 
-// Redraw the rows on the game field. The frog is not redrawn.
+// Redraw the rows on the game field
 static void redraw_whole_display(void) {
 	// Clear the display
 	ledmatrix_clear();
 	
-	// Start with the starting and halfway rows
-	redraw_roadside(START_ROW);
-	redraw_roadside(HALFWAY_ROW);
-
-	// Redraw traffic lanes
-	for(uint8_t lane=0; lane<=2; lane++) {
-		redraw_traffic_lane(lane);
-	}
-	// Redraw river
-	for(uint8_t channel=0; channel<=1; channel++) {
-		redraw_river_channel(channel);
-	}
-	// Redraw riverbank
-	redraw_riverbank();
-}
-
-// Redraw the row with the given number (0 to 7). The frog is not redrawn.
-static void redraw_row(uint8_t row) {	
-	// Remove frog from current position (we need to update the display
-	// so it shows the right colour pixel in its place). We know the frog
-	// must be either on a road edge, on the road or on a log.
-	switch(row) {
-		case START_ROW:
-		case HALFWAY_ROW:
-			redraw_roadside(row);
-			break;
-		case FIRST_VEHICLE_ROW:
-		case SECOND_VEHICLE_ROW:
-		case THIRD_VEHICLE_ROW:
-			redraw_traffic_lane(row-1);
-			break;
-		case FIRST_RIVER_ROW:
-		case SECOND_RIVER_ROW:
-			redraw_river_channel(row-5);
-			break;
-		case RIVERBANK_ROW:
-			redraw_riverbank();
-			break;
-		default:
-			// Invalid row - ignore
-			break;
-	}
-}
-
-
-// Redraw the given roadside row (0 or 4). The frog is not redrawn.
-void redraw_roadside(uint8_t row) {
-	MatrixRow row_display_data;
-	uint8_t i;
-	for(i=0;i<=15;i++) {
-		row_display_data[i] = COLOUR_EDGES;
-	}
-	ledmatrix_update_row(row, row_display_data);
-}
-
-// Redraw the given traffic lane (0, 1, 2). The frog is not redrawn.
-static void redraw_traffic_lane(uint8_t lane) {
-	MatrixRow row_display_data;
-	uint8_t i;
-	uint8_t bit_position = lane_position[lane];
-	for(i=0; i<=15; i++) {
-		if((lane_data[get_level_data_index()][lane] >> bit_position) & 1) {
-			row_display_data[i] = get_vehicle_colour(lane);
-			} else {
-			row_display_data[i] = COLOUR_ROAD;
-		}
-		bit_position++;
-		if(bit_position >= LANE_DATA_WIDTH) {
-			// Wrap around in our lane data
-			bit_position = 0;
-		}
+	compositor_set_layer(LAYER_BACKGROUND, draw_background);
+	compositor_set_layer(LAYER_TRAFFIC, draw_traffic);
+	compositor_set_layer(LAYER_LOGS, draw_logs);
+	compositor_set_layer(LAYER_FROG, draw_frog);
+	compositor_mark_all_dirty();
+}
+
+// Redraw the vehicles or logs of a moving row (0 to NUM_MOVING_ROWS-1). 
+// The row is sent to the LED matrix with the other changes (see 
+// show_changes()).
+static void redraw_moving_row(uint8_t index) {
+	compositor_mark_dirty(index < FIRST_CHANNEL_INDEX ? LAYER_TRAFFIC : LAYER_LOGS,
+			0, MOVING_ROW(index), BOARD_NUM_COLUMNS, 1);
+}
+
+// Redraw the frog layer where the frog is. This is done before the frog
+// moves (to remove it) and after (to show it).
+static void redraw_frog(void) {
+	compositor_mark_dirty(LAYER_FROG, frog_column, frog_row, 1, 1);
+}
+
+// Send the changes to the LED matrix, unless a display batch is open. The
+// compositor redraws the parts of the layers which changed and sends 
+// their rows together, so the LED matrix module can pick the cheapest
+// commands for all of them.
+static void show_changes(void) {
+	if(!display_batch_depth) {
+		compositor_show();
 	}
-	ledmatrix_update_row(lane+FIRST_VEHICLE_ROW, row_display_data);
 }
 
-// Redraw the given river channel (0 or 1). The frog is not redrawn.
-static void redraw_river_channel(uint8_t channel) {
-	MatrixRow row_display_data;
-	uint8_t i;
-	uint8_t bit_position = log_position[channel];
-	for(i=0; i<=15; i++) {
-		if((log_data[get_level_data_index()][channel] >> bit_position) & 1) {
-			row_display_data[i] = get_log_colour();
-			} else {
-			row_display_data[i] = COLOUR_WATER;
-		}
-		bit_position++;
-		if(bit_position >= LOG_DATA_WIDTH) {
-			bit_position = 0;
+// The layers (see compositor.h). Each draws its part of row y of the LED
+// matrix - the board rows are the matrix rows. If the board is larger than
+// the matrix, only the part which fits is drawn.
+
+// Roadside and the riverbank edges (the holes are empty unless a frog is
+// in them), road and water
+static void draw_background(uint8_t y, MatrixRow matrix_row) {
+	if(y == START_ROW || y == HALFWAY_ROW || y == RIVERBANK_ROW) {
+		RowMask mask = (y == RIVERBANK_ROW) ? riverbank : ROW_MASK_ALL;
+		for(uint8_t i=0; i<MATRIX_NUM_COLUMNS && i<BOARD_NUM_COLUMNS; i++) {
+			if(mask & 1) {
+				SET_MATRIX_PIXEL(matrix_row, i, PALETTE_EDGES);
+			}
+			mask >>= 1;
 		}
+	} else if(y < HALFWAY_ROW) {
+		set_matrix_row_to_colour(matrix_row, PALETTE_ROAD);
+	} else if(y < RIVERBANK_ROW) {
+		set_matrix_row_to_colour(matrix_row, PALETTE_WATER);
 	}
-	ledmatrix_update_row(channel+FIRST_RIVER_ROW, row_display_data);
-}
-
-// Redraw the riverbank (top row). Previous frogs which have made it to a hole
-// at the top are shown.
-void redraw_riverbank(void) {
-	MatrixRow row_display_data;
-	uint8_t i;
-	// Blank out spaces in our rowdata where there are holes in the riverbank
-	for(i=0; i<= 15; i++) {
-		if((riverbank >> i) & 1) {
-			// Riverbank edge
-			row_display_data[i] = COLOUR_EDGES;
-		} else if ((riverbank_status >> i) & 1) {
-			// Frog occupying a hole
-			row_display_data[i] = COLOUR_FROG;
-		} else {
-			// Empty hole
-			row_display_data[i] = 0;
-		}
+}
+
+// The vehicles, each in its own colour
+static void draw_traffic(uint8_t y, MatrixRow matrix_row) {
+	if(y >= FIRST_VEHICLE_ROW && y < HALFWAY_ROW) {
+		entities_draw_row(y - FIRST_VEHICLE_ROW, matrix_row);
 	}
-	// Output our riverbank to the display
-	ledmatrix_update_row(RIVERBANK_ROW, row_display_data);
 }
 
-// Redraw the frog in its current position.
-static void redraw_frog(void) {
-	if(frog_dead) {
-		ledmatrix_update_pixel(frog_column, frog_row, COLOUR_DEAD_FROG);
-	} else {
-		ledmatrix_update_pixel(frog_column, frog_row, COLOUR_FROG);
+static void draw_logs(uint8_t y, MatrixRow matrix_row) {
+	if(y >= FIRST_RIVER_ROW && y < RIVERBANK_ROW) {
+		entities_draw_row(y - FIRST_RIVER_ROW + FIRST_CHANNEL_INDEX, matrix_row);
 	}
-}
\ No newline at end of file
+}
+
+// The frog, and the frogs which have made it to a hole in the riverbank
+static void draw_frog(uint8_t y, MatrixRow matrix_row) {
+	if(y == RIVERBANK_ROW) {
+		RowMask frogs = riverbank_status & ~riverbank;
+		for(uint8_t i=0; i<MATRIX_NUM_COLUMNS && i<BOARD_NUM_COLUMNS; i++) {
+			if((frogs >> i) & 1) {
+				SET_MATRIX_PIXEL(matrix_row, i, PALETTE_FROG);
+			}
+		}
+	}
+	if(y == frog_row && frog_column >= 0 && frog_column < MATRIX_NUM_COLUMNS) {
+		SET_MATRIX_PIXEL(matrix_row, frog_column, frog_dead ? PALETTE_DEAD_FROG : PALETTE_FROG);
+	}
+}
@@ -9,16 +9,31 @@
  * before arriving at the other side of the road (row 4) 
  * where it is safe. It then has to cross a river by jumping
  * on to logs (rows 5 and 6) before jumping into into a hole
- * on the riverbank (row 7).
+ * on the riverbank (row 7). (These are the default sizes - 
+ * see playfield.h.)
  *
  * The functions in this module will update the LED matrix
- * display as required. 
+ * display as required. The display is drawn in layers (see
+ * compositor.h) - the parts which change are redrawn at the
+ * end of each call and sent to the LED matrix together, so
+ * that (for example) a move only sends the pixels the frog 
+ * left and arrived in.
  */ 
 
 #ifndef GAME_H_
 #define GAME_H_
 
 #include <stdint.h>
+#include "playfield.h"
+
+// Palette entries of the LED matrix the game is drawn with (see 
+// ledmatrix.h) - e.g. for animations which flash the frog. The vehicle
+// and log colours of the level follow PALETTE_FIRST_LEVEL_COLOUR.
+#define PALETTE_BLACK		0
+#define PALETTE_FROG		1
+#define PALETTE_DEAD_FROG	2
+#define PALETTE_EDGES		3
+#define PALETTE_FIRST_LEVEL_COLOUR 4
 
 // Reset the game. Get the road and river ready and place a frog
 // on the roadside (bottom row)
@@ -29,15 +44,25 @@ void initialise_game(void);
 // successfully to the other side.)
 void put_frog_in_start_position(void);
 
-void redraw_roadside(uint8_t row);
-void redraw_riverbank(void);
+// Kill the frog where it is (e.g. when it has run out of time). It is
+// shown dead.
+void kill_frog(void);
+
+// Hold back the display changes made by the functions in this module
+// until end_display_batch() is called, so that several updates (e.g. all
+// the rows which scroll in one tick) are sent to the LED matrix together.
+// Batches may be nested - the changes are sent when the outermost batch
+// ends.
+void begin_display_batch(void);
+void end_display_batch(void);
 
 /////////////////////////////////// MOVE FUNCTIONS /////////////////////////
 // is_frog_dead() should be checked after calling one of these to see
 // if the move succeeded or not
 
 // Move the frog one row forward.
-// This function must NOT be called if the frog is in row 7 (i.e. home).
+// This function must NOT be called if the frog is in the riverbank row
+// (i.e. home).
 // Failure may occur if the frog jumps into a vehicle or jumps in the water 
 // or jumps into the riverbank. 
 void move_frog_forward(void);
@@ -61,8 +86,9 @@ void move_frog_up_left(void);
 void move_frog_down_left(void);
 
 /////////////////////// FROG / GAME STATUS ///////////////////////////////////
-// Return the position of the frog. The row ranges from 0 (bottom) to 7 (top).
-// The column ranges from 0 (left hand side) to 1 (right hand side)
+// Return the position of the frog. The row ranges from 0 (bottom) to 
+// RIVERBANK_ROW (top). The column ranges from 0 (left hand side) to 
+// LAST_COLUMN (right hand side)
 uint8_t get_frog_row(void);
 uint8_t get_frog_column(void);
 
@@ -92,13 +118,20 @@ uint8_t get_level(void);
 // Sets the level to the initial value (1)
 void init_level(void);
 
-// Sets the current game level to the value passed
+// Sets the current game level to the value passed. This also works out
+// the speeds of the rows for the level (see get_moving_row_velocity()).
 void set_level(uint8_t new_level);
 
+// Set/get the seed from which the levels after the built-in ones are
+// generated (see levelgen.h). This takes effect from the next set_level().
+void set_level_seed(uint32_t seed);
+uint32_t get_level_seed(void);
+
 /////////////////////// UPDATE FUNCTIONS /////////////////////////////////////
 // Scroll the given lane of traffic in the given direction. 
 // Check is_frog_dead() to determine whether the frog was killed or not.
-// lane argument is 0, 1 or 2 corresponding to rows 1, 2 and 3 on the display.
+// lane argument is 0 to NUM_LANES-1 corresponding to rows 1 upwards on the
+// display.
 // direction argument is -1 for left, 1 for right, 0 for no scroll (just redraw)
 void scroll_vehicle_lane(uint8_t lane, int8_t direction);
 
@@ -106,8 +139,53 @@ void scroll_vehicle_lane(uint8_t lane, int8_t direction);
 // the given direction.
 // Check is_frog_dead() to determine whether the frog was killed or not.
 // (Frog dies if it hits the edge of the game field whilst on a log.)
-// log argument is 0 or 1 (corresponding to rows 5 and 6 on the display).
+// log argument is 0 to NUM_CHANNELS-1 (corresponding to FIRST_RIVER_ROW 
+// upwards on the display).
 // direction argument is -1 for left, 1 for right, 0 for no scroll (just redraw)
 void scroll_river_channel (uint8_t channel, int8_t direction);
 
+// The traffic lanes and river channels each scroll at their own speed. 
+// These are numbered 0 to NUM_MOVING_ROWS-1 (the lanes, then the channels 
+// - see playfield.h).
+
+// Speed of a moving row in columns per ms, as a fixed point fraction with
+// 32 bits after the binary point. Rows move less than one column per ms.
+typedef uint32_t RowVelocity;
+
+// Return the speed of the given moving row (0 to NUM_MOVING_ROWS-1) at 
+// the current level
+RowVelocity get_moving_row_velocity(uint8_t index);
+
+// Return how far the given moving row has moved since it last scrolled,
+// as a 32 bit fraction of a column. The rows start each level at 0.
+uint32_t get_moving_row_phase(uint8_t index);
+
+// Move every moving row on by the given time (ms) at its own speed, 
+// scrolling it each time it has moved a whole column. All the rows are
+// driven from this one clock. Stops if the frog is killed.
+void advance_moving_rows(uint16_t ms);
+
+// Scroll the given moving row (0 to NUM_MOVING_ROWS-1) one column in its
+// direction.
+// Check is_frog_dead() to determine whether the frog was killed or not.
+void scroll_moving_row(uint8_t index);
+
+// Return the position of the given moving row (0 to NUM_MOVING_ROWS-1) - 
+// the bit position of its pattern shown in column 0 of the display
+uint8_t get_moving_row_position(uint8_t index);
+
+// Return the riverbank - a 1 is the bank or a hole with a frog in it, 0 is
+// an empty hole. Column 0 is the least significant bit.
+RowMask get_riverbank_status(void);
+
+// Return the descriptor of the current level (see levels.h)
+struct LevelDescriptor;
+const struct LevelDescriptor* get_level_descriptor(void);
+
+/////////////////////// STATISTICS ///////////////////////////////////////////
+// Number of times we have checked whether the frog dies at a position
+// (after a move or when the row it is in scrolls)
+uint32_t get_collision_checks(void);
+void reset_collision_checks(void);
+
 #endif /* GAME_H_ */
\ No newline at end of file
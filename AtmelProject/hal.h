@@ -0,0 +1,98 @@
+/*
+ * hal.h
+ *
+ * Hardware abstraction layer.
+ *
+ * The game modules (game.c, score.c, sound_effects.c, sevenseg.c,
+ * joystick.c, ledmatrix.c, highscores.c, input.c and project.c) do not
+ * access the ATmega324A registers directly. They use:
+ * - timer0.h as the time source
+ * - spi.h as the display sink (the LED matrix command bytes)
+ * - buttons.h and serialio.h (with stdio) as input sources
+ * - the functions below for the remaining I/O (push button state, lives
+ *   LEDs, seven segment display, joystick ADC, piezo tone output) and
+ *   the avr-libc style EEPROM and program memory functions.
+ *
+ * There are two backends:
+ * - AVR: hal_avr.c together with the existing timer0.c, spi.c, buttons.c
+ *   and serialio.c drivers.
+ * - Linux: host/hal_host.c (see host/Makefile). Time is simulated (or
+ *   taken from the system clock), display bytes go to a counting sink
+ *   and input is injected by the program driving the game. This lets the
+ *   same game code run headless on a workstation.
+ */
+
+#ifndef HAL_H_
+#define HAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#include <avr/eeprom.h>
+#else
+/* Program memory and EEPROM are ordinary RAM on the host. */
+#define PROGMEM
+#define EEMEM
+#define PSTR(s) (s)
+#define printf_P printf
+#define pgm_read_byte(addr) (*(const uint8_t*)(addr))
+#define pgm_read_word(addr) (*(const uint16_t*)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t*)(addr))
+#define pgm_read_ptr(addr) (*(const void* const*)(addr))
+#define memcpy_P memcpy
+
+uint8_t eeprom_read_byte(const uint8_t* addr);
+uint16_t eeprom_read_word(const uint16_t* addr);
+void eeprom_read_block(void* dst, const void* src, size_t n);
+void eeprom_write_byte(uint8_t* addr, uint8_t value);
+void eeprom_write_word(uint16_t* addr, uint16_t value);
+void eeprom_write_block(const void* src, void* dst, size_t n);
+#endif
+
+/* Turn on global interrupts (after all the drivers have been set up) */
+void hal_enable_interrupts(void);
+
+/* Busy wait for the given number of milliseconds */
+void hal_delay_ms(uint16_t ms);
+
+/* Put the CPU into idle sleep mode until the next interrupt (the timer0
+ * tick, serial receive, push button pin change, ...), unless work_due()
+ * returns non-zero. work_due() is called with interrupts disabled, so no
+ * interrupt can arrive between it and going to sleep - one which does
+ * arrive meanwhile wakes us straight away. Interrupts must be enabled,
+ * and are enabled again on return. Returns 1 if we slept.
+ */
+uint8_t hal_idle_sleep(uint8_t (*work_due)(void));
+
+/* Return a bit mask of the push buttons (B0 to B3) currently held down.
+ * Bit n is set if button n is down.
+ */
+uint8_t hal_buttons_held(void);
+
+/* Lives LEDs - on the upper 4 bits of port A */
+void hal_init_lives_leds(void);
+void hal_show_lives(uint8_t num_lives);
+
+/* Seven segment display. segments is the segment pattern (bit 0 = segment
+ * A, bit 7 = DP) and digit selects the left (1) or right (0) digit.
+ */
+void hal_init_sevenseg(void);
+void hal_sevenseg_output(uint8_t segments, uint8_t digit);
+
+/* ADC - used for the joystick (channel 0 = left/right, 1 = up/down).
+ * hal_adc_read() returns a 10 bit conversion result.
+ */
+void hal_init_adc(void);
+uint16_t hal_adc_read(uint8_t channel);
+
+/* Piezo buzzer tone output. hal_tone_start() honours the mute and
+ * volume switches.
+ */
+void hal_init_tone(void);
+void hal_tone_start(uint16_t freq);
+void hal_tone_stop(void);
+
+#endif /* HAL_H_ */
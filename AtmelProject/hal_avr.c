@@ -0,0 +1,177 @@
+/*
+ * hal_avr.c
+ *
+ * ATmega324A backend for the hardware abstraction layer (see hal.h).
+ * Timing, SPI, button and serial I/O are provided by the existing
+ * timer0.c, spi.c, buttons.c and serialio.c drivers. This file covers
+ * the remaining port, ADC and timer/counter 1 accesses.
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+
+#include "hal.h"
+
+#define F_CPU 8000000L
+#include <util/delay.h>
+
+void hal_enable_interrupts(void) {
+	sei();
+}
+
+void hal_delay_ms(uint16_t ms) {
+	// _delay_ms() needs a compile time constant to be accurate
+	while(ms--) {
+		_delay_ms(1);
+	}
+}
+
+uint8_t hal_idle_sleep(uint8_t (*work_due)(void)) {
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	cli();
+	if(work_due()) {
+		sei();
+		return 0;
+	}
+	sleep_enable();
+	// The instruction following sei() is always executed before any
+	// pending interrupt, so an interrupt which arrived since cli() (or
+	// arrives now) is left pending until we are asleep, and then wakes
+	// us straight away.
+	sei();
+	sleep_cpu();
+	sleep_disable();
+	return 1;
+}
+
+uint8_t hal_buttons_held(void) {
+	// Buttons B0 to B3 are connected to pins B0 to B3
+	return PINB & 0x0F;
+}
+
+void hal_init_lives_leds(void) {
+	// LEDs are on the upper 4 bits of Port A
+	DDRA |= 0xF0;
+}
+
+void hal_show_lives(uint8_t num_lives) {
+	// Clear Port A
+	PORTA = 0;
+	// LEDs for lives use upper 4 bits of Port A
+	for (int8_t i = 0; i < num_lives; ++i) {
+		PORTA |= (1<<(i+4));
+	}
+}
+
+void hal_init_sevenseg(void) {
+	/* Set port C (all pins) to be outputs */
+	DDRC = 0xFF;
+
+	/* Set port A, pin 3 to be an output */
+	DDRA |= (1 << 3);
+}
+
+/* The seven segment display is connected to port C pins 0-7, with the CC
+ * (digit select) pin connected to port A, pin 3.
+ */
+void hal_sevenseg_output(uint8_t segments, uint8_t digit) {
+	// Set port A pin 3 to the digit (1 or 0)
+	if (digit == 1) {
+		PORTA |= (1 << 3);
+	} else {
+		PORTA &= ~(1 << 3);
+	}
+	PORTC = segments;
+}
+
+void hal_init_adc(void) {
+	/* Set up ADC - AVCC reference, right adjust */
+	ADMUX = (1<<REFS0);
+
+	/* Turn on the ADC (but don't start a conversion yet).
+	 * Choose a clock divider of 64.
+	 */
+	ADCSRA = (1<<ADEN)|(1<<ADPS2)|(1<<ADPS1);
+}
+
+uint16_t hal_adc_read(uint8_t channel) {
+	// Set the ADC mux to the given channel
+	ADMUX = (ADMUX & 0xE0) | (channel & 0x1F);
+	// Start the ADC conversion
+	ADCSRA |= (1<<ADSC);
+
+	while (ADCSRA & (1<<ADSC)) {
+		; // Wait until conversion is finished
+	}
+	return ADC;
+}
+
+/* The piezo buzzer is connected to the OC1B pin (port D, pin 4). Switch S7
+ * (port D, pin 7) mutes the sound and switch S6 (port D, pin 6) selects
+ * high or low volume.
+ */
+void hal_init_tone(void) {
+	// Make pin OC1B be an output (port D, pin 4). Other port D pins are
+	// LED matrix slave selects (see spi.h) so we leave them alone.
+	DDRD |= (1<<4);
+}
+
+// For a given frequency (Hz), return the clock period (in terms of the
+// number of clock cycles of a 1MHz clock)
+static uint16_t freq_to_clock_period(uint16_t freq) {
+	return (1000000UL / freq);	// UL makes the constant an unsigned long (32 bits)
+	// and ensures we do 32 bit arithmetic, not 16
+}
+
+// Return the width of a pulse (in clock cycles) given a duty cycle (%) and
+// the period of the clock (measured in clock cycles)
+static uint16_t duty_cycle_to_pulse_width(uint8_t dutycycle, uint16_t clockperiod) {
+	return ((uint32_t)dutycycle * clockperiod) / 100;
+}
+
+void hal_tone_start(uint16_t freq) {
+	uint16_t clockperiod;
+	uint16_t pulsewidth;
+	uint8_t dutycycle;
+
+	// Don't play sound if the game is muted (ie. switch 7 is in off position, 0)
+	if ((PIND & 0b10000000) == 0) {
+		return;
+	}
+
+	// Determine the duty cycle based on the volume high/low switch (switch 6)
+	if ((PIND & 0b01000000) == 0) {
+		// Quieter output, lower duty cycle
+		dutycycle = 1;		// %
+	} else {
+		dutycycle = 5;
+	}
+
+	clockperiod = freq_to_clock_period(freq);
+	pulsewidth = duty_cycle_to_pulse_width(dutycycle, clockperiod);
+
+	// Set the maximum count value for timer/counter 1 to be one less than the clockperiod
+	OCR1A = clockperiod - 1;
+
+	// Set the count compare value based on the pulse width. The value will be 1 less
+	// than the pulse width - unless the pulse width is 0.
+	if(pulsewidth == 0) {
+		OCR1B = 0;
+	} else {
+		OCR1B = pulsewidth - 1;
+	}
+
+	// Set up timer/counter 1 for Fast PWM, counting from 0 to the value in OCR1A
+	// before reseting to 0. Count at 1MHz (CLK/8).
+	// Configure output OC1B to be clear on compare match and set on timer/counter
+	// overflow (non-inverting mode).
+	TCCR1A = (1 << COM1B1) | (0 <<COM1B0) | (1 <<WGM11) | (1 << WGM10);
+	TCCR1B = (1 << WGM13) | (1 << WGM12) | (0 << CS12) | (1 << CS11) | (0 << CS10);
+
+	// Buzzer should now be buzzing
+}
+
+void hal_tone_stop(void) {
+	TCCR1A = 0; // Reverts OC1A/OC1B to normal port operation, disconnecting the buzzer
+}
@@ -5,8 +5,7 @@
  */ 
 
 #include <stdio.h>
-#include <avr/eeprom.h>
-#include <avr/pgmspace.h>
+#include "hal.h"
 #include "terminalio.h"
 
 /* The letter J (ASCII 74) is the required signature,
@@ -195,4 +194,9 @@ void draw_high_scores(uint8_t x, uint8_t y) {
 			printf_P(PSTR("%d. %d - %s"), i + 1, scores[i], names[i]);
 		}
 	}
-}
\ No newline at end of file
+}
+
+uint16_t get_top_high_score(void) {
+	// Scores are sorted in descending order by draw_high_scores()
+	return slots_used ? scores[0] : 0;
+}
@@ -8,4 +8,7 @@ uint8_t is_high_score(uint16_t score);
 
 void save_high_score(uint16_t score, uint8_t *name);
 
-void draw_high_scores(uint8_t x, uint8_t y);
\ No newline at end of file
+void draw_high_scores(uint8_t x, uint8_t y);
+
+/* Returns the highest score drawn by draw_high_scores() (0 if none) */
+uint16_t get_top_high_score(void);
\ No newline at end of file
@@ -0,0 +1,324 @@
+/*
+ * bench.c
+ *
+ * Benchmark of the game core (game.c) on the host. Each session plays the
+ * game with simulated time - the lanes move on every ms as in play_game()
+ * and the frog moves every 200ms, either following a script
+ * or at random. The display bytes go to a counting sink which also
+ * splits them into LED matrix commands.
+ *
+ * For each session we report (as JSON on standard output):
+ * - simulated ticks (ms) run per second of host time
+ * - display commands and bytes per game second
+ * - collision checks made
+ * - calls to and host time spent in each game function
+ *
+ * We then fill the entity pool (see ../entities.h) - ENTITY_POOL_SIZE
+ * entities of mixed speeds over the rows of level 1 - and report the host
+ * time to move and rasterise all of them, as if every row moved every 
+ * tick.
+ *
+ * Usage: bench [simulated_seconds_per_session]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hal_host.h"
+#include "entities.h"
+#include "game.h"
+#include "ledmatrix.h"
+#include "score.h"
+#include "timer0.h"
+
+#define MOVE_INTERVAL 200 // ms between frog moves
+#define ENTITY_POOL_TICKS 10000
+
+// LED matrix commands (see ledmatrix.c) and the number of data bytes
+// which follow each command byte
+#define CMD_UPDATE_ALL 0x00
+#define CMD_UPDATE_PIXEL 0x01
+#define CMD_UPDATE_ROW 0x02
+#define CMD_UPDATE_COL 0x03
+#define CMD_SHIFT_DISPLAY 0x04
+#define CMD_CLEAR_SCREEN 0x0F
+
+static uint8_t command_data_bytes(uint8_t command) {
+	switch(command) {
+		case CMD_UPDATE_ALL:
+			return PANEL_NUM_COLUMNS * PANEL_NUM_ROWS;
+		case CMD_UPDATE_PIXEL:
+			return 2;
+		case CMD_UPDATE_ROW:
+			return 1 + PANEL_NUM_COLUMNS;
+		case CMD_UPDATE_COL:
+			return 1 + PANEL_NUM_ROWS;
+		case CMD_SHIFT_DISPLAY:
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+// Display sink - counts commands as well as bytes
+static uint32_t display_commands;
+static uint8_t data_bytes_expected;
+
+static void count_display_byte(uint8_t byte) {
+	if(data_bytes_expected) {
+		data_bytes_expected--;
+	} else {
+		display_commands++;
+		data_bytes_expected = command_data_bytes(byte);
+	}
+}
+
+// Game functions we time
+enum {
+	FN_INITIALISE_GAME,
+	FN_PUT_FROG_IN_START_POSITION,
+	FN_MOVE_FROG_FORWARD,
+	FN_MOVE_FROG_BACKWARD,
+	FN_MOVE_FROG_TO_LEFT,
+	FN_MOVE_FROG_TO_RIGHT,
+	FN_ADVANCE_MOVING_ROWS,
+	NUM_FUNCTIONS
+};
+
+static const char* function_names[NUM_FUNCTIONS] = {
+	"initialise_game",
+	"put_frog_in_start_position",
+	"move_frog_forward",
+	"move_frog_backward",
+	"move_frog_to_left",
+	"move_frog_to_right",
+	"advance_moving_rows"
+};
+
+static uint32_t function_calls[NUM_FUNCTIONS];
+static uint64_t function_ns[NUM_FUNCTIONS];
+
+static uint64_t now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + now.tv_nsec;
+}
+
+// Call a game function, adding the time it takes to its total
+#define TIMED(fn, call) do { \
+		uint64_t call_start = now_ns(); \
+		call; \
+		function_ns[fn] += now_ns() - call_start; \
+		function_calls[fn]++; \
+	} while(0)
+
+// Sessions. A scripted session repeats its moves (F = forward,
+// B = backward, L = left, R = right, . = no move); a session without a
+// script moves at random.
+typedef struct {
+	const char* name;
+	const char* script;
+	uint32_t seed;
+} Session;
+
+static const Session sessions[] = {
+	{ "idle", ".", 0 },
+	{ "forward", "F", 0 },
+	{ "cross_and_wait", "FFFF....FFF..", 0 },
+	{ "zigzag", "FLFRBLBR", 0 },
+	{ "random_1", NULL, 1 },
+	{ "random_2", NULL, 2 },
+	{ "random_3", NULL, 3 }
+};
+#define NUM_SESSIONS (sizeof(sessions) / sizeof(sessions[0]))
+
+static uint32_t random_state;
+
+static uint32_t next_random(void) {
+	// xorshift32
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+static void new_game(void) {
+	init_score();
+	init_lives();
+	init_level();
+	TIMED(FN_INITIALISE_GAME, initialise_game());
+}
+
+static void move(char direction) {
+	switch(direction) {
+		case 'F':
+			if(!frog_has_reached_riverbank()) {
+				TIMED(FN_MOVE_FROG_FORWARD, move_frog_forward());
+			}
+			break;
+		case 'B':
+			TIMED(FN_MOVE_FROG_BACKWARD, move_frog_backward());
+			break;
+		case 'L':
+			TIMED(FN_MOVE_FROG_TO_LEFT, move_frog_to_left());
+			break;
+		case 'R':
+			TIMED(FN_MOVE_FROG_TO_RIGHT, move_frog_to_right());
+			break;
+	}
+}
+
+static void run_session(const Session* session, uint32_t simulated_seconds, FILE* report) {
+	uint32_t games = 0, deaths = 0, levels = 0;
+	uint32_t moves = 0;
+	uint64_t start_ns, elapsed_ns;
+
+	random_state = session->seed ? session->seed : 1;
+	for(uint8_t fn = 0; fn < NUM_FUNCTIONS; fn++) {
+		function_calls[fn] = 0;
+		function_ns[fn] = 0;
+	}
+
+	init_timer0();
+	ledmatrix_setup();
+	hal_host_reset_display_bytes();
+	display_commands = 0;
+	data_bytes_expected = 0;
+	reset_collision_checks();
+
+	start_ns = now_ns();
+	new_game();
+	for(uint32_t tick = 1; tick <= simulated_seconds * 1000; tick++) {
+		hal_host_advance_time(1);
+		uint32_t current_time = get_current_time();
+
+		if(is_frog_dead()) {
+			deaths++;
+			set_lives(get_lives_remaining() - 1);
+			if(get_lives_remaining() == 0) {
+				games++;
+				new_game();
+			} else {
+				TIMED(FN_PUT_FROG_IN_START_POSITION, put_frog_in_start_position());
+			}
+		} else if(is_riverbank_full()) {
+			levels++;
+			set_level(get_level() + 1);
+			set_lives(get_lives_remaining() + 1);
+			TIMED(FN_INITIALISE_GAME, initialise_game());
+		} else if(frog_has_reached_riverbank()) {
+			add_to_score(10);
+			TIMED(FN_PUT_FROG_IN_START_POSITION, put_frog_in_start_position());
+		}
+
+		if(current_time % MOVE_INTERVAL == 0) {
+			if(session->script) {
+				move(session->script[moves++ % strlen(session->script)]);
+			} else {
+				move("FBLR"[next_random() % 4]);
+			}
+		}
+
+		if(!is_frog_dead()) {
+			TIMED(FN_ADVANCE_MOVING_ROWS, advance_moving_rows(1));
+		}
+	}
+	elapsed_ns = now_ns() - start_ns;
+
+	double host_seconds = elapsed_ns / 1e9;
+	fprintf(report, "    {\n");
+	fprintf(report, "      \"name\": \"%s\",\n", session->name);
+	fprintf(report, "      \"simulated_ticks\": %lu,\n", (unsigned long)simulated_seconds * 1000);
+	fprintf(report, "      \"host_seconds\": %.6f,\n", host_seconds);
+	fprintf(report, "      \"ticks_per_second\": %.0f,\n", simulated_seconds * 1000 / host_seconds);
+	fprintf(report, "      \"display_commands\": %lu,\n", (unsigned long)display_commands);
+	fprintf(report, "      \"display_bytes\": %lu,\n", (unsigned long)hal_host_get_display_bytes());
+	fprintf(report, "      \"commands_per_game_second\": %.2f,\n", (double)display_commands / simulated_seconds);
+	fprintf(report, "      \"bytes_per_game_second\": %.2f,\n", (double)hal_host_get_display_bytes() / simulated_seconds);
+	fprintf(report, "      \"collision_checks\": %lu,\n", (unsigned long)get_collision_checks());
+	fprintf(report, "      \"games\": %lu,\n", (unsigned long)games);
+	fprintf(report, "      \"deaths\": %lu,\n", (unsigned long)deaths);
+	fprintf(report, "      \"levels\": %lu,\n", (unsigned long)levels);
+	fprintf(report, "      \"functions\": {\n");
+	for(uint8_t fn = 0; fn < NUM_FUNCTIONS; fn++) {
+		fprintf(report, "        \"%s\": { \"calls\": %lu, \"total_ns\": %llu, \"ns_per_call\": %.1f }%s\n",
+				function_names[fn], (unsigned long)function_calls[fn],
+				(unsigned long long)function_ns[fn],
+				function_calls[fn] ? (double)function_ns[fn] / function_calls[fn] : 0.0,
+				fn < NUM_FUNCTIONS - 1 ? "," : "");
+	}
+	fprintf(report, "      }\n");
+	fprintf(report, "    }");
+}
+
+static void run_entity_pool(FILE* report) {
+	const LevelDescriptor* level_data;
+	uint64_t start_ns, elapsed_ns;
+
+	init_level();
+	level_data = get_level_descriptor();
+	entities_clear(level_data);
+	random_state = 1;
+	for(uint8_t i = 0; i < NUM_MOVING_ROWS; i++) {
+		const LevelRow* row = &level_data->rows[i];
+		while(entities_count() < (uint32_t)ENTITY_POOL_SIZE * (i + 1) / NUM_MOVING_ROWS) {
+			entities_add(i, next_random() % row->width, 1 + next_random() % 4,
+					1 + next_random() % 3, ledmatrix_palette_index(row->colour));
+		}
+	}
+
+	start_ns = now_ns();
+	for(uint32_t tick = 0; tick < ENTITY_POOL_TICKS; tick++) {
+		for(uint8_t i = 0; i < NUM_MOVING_ROWS; i++) {
+			entities_update_row(i, tick % level_data->rows[i].width, 
+					tick * get_moving_row_velocity(i));
+			entities_row_mask(i);
+		}
+	}
+	elapsed_ns = now_ns() - start_ns;
+
+	fprintf(report, "  \"entity_pool\": {\n");
+	fprintf(report, "    \"entities\": %lu,\n", (unsigned long)entities_count());
+	fprintf(report, "    \"ticks\": %lu,\n", (unsigned long)ENTITY_POOL_TICKS);
+	fprintf(report, "    \"ns_per_tick\": %.1f,\n", (double)elapsed_ns / ENTITY_POOL_TICKS);
+	fprintf(report, "    \"ns_per_entity\": %.2f\n", 
+			(double)elapsed_ns / ENTITY_POOL_TICKS / entities_count());
+	fprintf(report, "  }\n");
+}
+
+int main(int argc, char** argv) {
+	uint32_t simulated_seconds = argc > 1 ? strtoul(argv[1], NULL, 10) : 600;
+	FILE* report;
+
+	if(simulated_seconds == 0) {
+		simulated_seconds = 1;
+	}
+
+	// The game writes score/level updates to the terminal (stdout) -
+	// discard those and write our report to the original stdout.
+	report = fdopen(dup(STDOUT_FILENO), "w");
+	if(!report || !freopen("/dev/null", "w", stdout)) {
+		return 1;
+	}
+
+	hal_host_use_simulated_time(1);
+	hal_host_set_display_sink(count_display_byte);
+
+	fprintf(report, "{\n  \"simulated_seconds_per_session\": %lu,\n  \"sessions\": [\n",
+			(unsigned long)simulated_seconds);
+	for(uint8_t i = 0; i < NUM_SESSIONS; i++) {
+		run_session(&sessions[i], simulated_seconds, report);
+		fprintf(report, "%s\n", i < NUM_SESSIONS - 1 ? "," : "");
+	}
+	fprintf(report, "  ],\n");
+	run_entity_pool(report);
+	fprintf(report, "}\n");
+	fclose(report);
+	return 0;
+}
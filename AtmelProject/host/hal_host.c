@@ -0,0 +1,309 @@
+/*
+ * hal_host.c
+ *
+ * Linux backend for the hardware abstraction layer (see ../hal.h and
+ * hal_host.h). Replaces timer0.c, spi.c, buttons.c, serialio.c and
+ * hal_avr.c in the host build.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "hal.h"
+#include "hal_host.h"
+#include "buttons.h"
+#include "serialio.h"
+#include "spi.h"
+#include "timer0.h"
+
+/////////////////////////////// Time source ////////////////////////////////
+
+static uint8_t simulated_time;
+static uint32_t simulated_ms;
+static struct timespec start_time;
+
+void hal_host_use_simulated_time(uint8_t simulated) {
+	simulated_time = simulated;
+}
+
+void hal_host_advance_time(uint32_t ms) {
+	simulated_ms += ms;
+}
+
+void init_timer0(void) {
+	simulated_ms = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start_time);
+}
+
+uint32_t get_current_time(void) {
+	struct timespec now;
+	if(simulated_time) {
+		return simulated_ms;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)((now.tv_sec - start_time.tv_sec) * 1000L
+			+ (now.tv_nsec - start_time.tv_nsec) / 1000000L);
+}
+
+uint32_t get_current_time_us(void) {
+	struct timespec now;
+	if(simulated_time) {
+		return simulated_ms * 1000;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint32_t)((now.tv_sec - start_time.tv_sec) * 1000000L
+			+ (now.tv_nsec - start_time.tv_nsec) / 1000L);
+}
+
+void hal_delay_ms(uint16_t ms) {
+	struct timespec delay;
+	if(simulated_time) {
+		simulated_ms += ms;
+		return;
+	}
+	delay.tv_sec = ms / 1000;
+	delay.tv_nsec = (ms % 1000) * 1000000L;
+	nanosleep(&delay, NULL);
+}
+
+// The next interrupt would be the timer0 tick - wait for that
+uint8_t hal_idle_sleep(uint8_t (*work_due)(void)) {
+	if(work_due()) {
+		return 0;
+	}
+	hal_delay_ms(1);
+	return 1;
+}
+
+void hal_enable_interrupts(void) {
+	// Nothing to do on the host
+}
+
+/////////////////////////////// Display sink ///////////////////////////////
+
+static HalHostDisplaySink display_sink;
+static uint32_t display_bytes;
+static uint8_t selected_device;
+
+void hal_host_set_display_sink(HalHostDisplaySink sink) {
+	display_sink = sink;
+}
+
+uint32_t hal_host_get_display_bytes(void) {
+	return display_bytes;
+}
+
+void hal_host_reset_display_bytes(void) {
+	display_bytes = 0;
+}
+
+uint8_t hal_host_get_selected_device(void) {
+	return selected_device;
+}
+
+void spi_setup_master(uint8_t clockdivider) {
+	(void)clockdivider;
+	selected_device = 0;
+}
+
+uint8_t spi_send_byte(uint8_t byte) {
+	display_bytes++;
+	if(display_sink) {
+		display_sink(byte);
+	}
+	return 0;
+}
+
+// There is no transmit queue on the host - bytes go straight to the sink
+void spi_queue_byte(uint8_t byte) {
+	(void)spi_send_byte(byte);
+}
+
+void spi_flush(void) {
+}
+
+void spi_queue_select(uint8_t device) {
+	if(device < SPI_NUM_DEVICES) {
+		selected_device = device;
+	}
+}
+
+// Sending is instant, so we never wait
+uint32_t spi_get_blocked_time(void) {
+	return 0;
+}
+
+void spi_reset_blocked_time(void) {
+}
+
+/////////////////////////////// Input sources //////////////////////////////
+
+// Same queue semantics as buttons.c - excess button pushes are discarded
+#define BUTTON_QUEUE_SIZE 4
+static uint8_t button_queue[BUTTON_QUEUE_SIZE];
+static int8_t queue_length;
+static uint8_t buttons_held;
+
+void hal_host_push_button(uint8_t button) {
+	if(queue_length < BUTTON_QUEUE_SIZE) {
+		button_queue[queue_length++] = button;
+	}
+}
+
+void hal_host_set_buttons_held(uint8_t buttons) {
+	buttons_held = buttons & 0x0F;
+}
+
+void init_button_interrupts(void) {
+	queue_length = 0;
+}
+
+int8_t button_pushed(void) {
+	int8_t return_value = NO_BUTTON_PUSHED;
+	if(queue_length > 0) {
+		return_value = button_queue[0];
+		for(uint8_t i = 1; i < queue_length; i++) {
+			button_queue[i-1] = button_queue[i];
+		}
+		queue_length--;
+	}
+	return return_value;
+}
+
+uint8_t hal_buttons_held(void) {
+	return buttons_held;
+}
+
+// Joystick ADC readings - mid scale (joystick idle) unless set
+static uint16_t adc_values[2] = { 512, 512 };
+
+void hal_host_set_adc(uint8_t channel, uint16_t value) {
+	if(channel < 2) {
+		adc_values[channel] = value;
+	}
+}
+
+void hal_init_adc(void) {
+}
+
+uint16_t hal_adc_read(uint8_t channel) {
+	return channel < 2 ? adc_values[channel] : 0;
+}
+
+// The serial port is standard input/output. If standard input is a
+// terminal we put it in non-canonical mode (no echo, no line buffering)
+// to match the UART.
+static struct termios saved_termios;
+static uint8_t termios_saved;
+
+static void restore_terminal(void) {
+	if(termios_saved) {
+		tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+	}
+}
+
+void init_serial_stdio(long baudrate, int8_t echo) {
+	struct termios raw;
+	(void)baudrate;
+	setvbuf(stdin, NULL, _IONBF, 0);
+	if(isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &saved_termios) == 0) {
+		termios_saved = 1;
+		atexit(restore_terminal);
+		raw = saved_termios;
+		raw.c_lflag &= ~ICANON;
+		if(!echo) {
+			raw.c_lflag &= ~ECHO;
+		}
+		tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+	}
+}
+
+int8_t serial_input_available(void) {
+	struct pollfd fd = { STDIN_FILENO, POLLIN, 0 };
+	fflush(stdout);
+	return poll(&fd, 1, 0) > 0 && (fd.revents & POLLIN);
+}
+
+void clear_serial_input_buffer(void) {
+	char c;
+	while(serial_input_available()) {
+		if(read(STDIN_FILENO, &c, 1) <= 0) {
+			break;
+		}
+	}
+}
+
+/////////////////////////////// Outputs ////////////////////////////////////
+
+static uint8_t lives_shown;
+static uint16_t tone_frequency;
+
+uint8_t hal_host_get_lives_shown(void) {
+	return lives_shown;
+}
+
+uint16_t hal_host_get_tone_frequency(void) {
+	return tone_frequency;
+}
+
+void hal_init_lives_leds(void) {
+}
+
+void hal_show_lives(uint8_t num_lives) {
+	lives_shown = num_lives;
+}
+
+void hal_init_sevenseg(void) {
+}
+
+void hal_sevenseg_output(uint8_t segments, uint8_t digit) {
+	(void)segments;
+	(void)digit;
+}
+
+void hal_init_tone(void) {
+}
+
+void hal_tone_start(uint16_t freq) {
+	tone_frequency = freq;
+}
+
+void hal_tone_stop(void) {
+	tone_frequency = 0;
+}
+
+/////////////////////////////// EEPROM /////////////////////////////////////
+// EEMEM variables are ordinary variables on the host, so EEPROM accesses
+// are just memory accesses (the contents do not persist between runs).
+
+uint8_t eeprom_read_byte(const uint8_t* addr) {
+	return *addr;
+}
+
+uint16_t eeprom_read_word(const uint16_t* addr) {
+	return *addr;
+}
+
+void eeprom_read_block(void* dst, const void* src, size_t n) {
+	memcpy(dst, src, n);
+}
+
+void eeprom_write_byte(uint8_t* addr, uint8_t value) {
+	*addr = value;
+}
+
+void eeprom_write_word(uint16_t* addr, uint16_t value) {
+	*addr = value;
+}
+
+void eeprom_write_block(const void* src, void* dst, size_t n) {
+	memcpy(dst, src, n);
+}
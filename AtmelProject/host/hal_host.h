@@ -0,0 +1,43 @@
+/*
+ * hal_host.h
+ *
+ * Linux backend for the hardware abstraction layer (see ../hal.h).
+ *
+ * hal_host.c implements the interfaces in timer0.h, spi.h, buttons.h,
+ * serialio.h and hal.h. The functions below let the program driving
+ * the game control simulated time and inject input, and let it observe
+ * the outputs.
+ */
+
+#ifndef HAL_HOST_H_
+#define HAL_HOST_H_
+
+#include <stdint.h>
+
+/* Time source. By default get_current_time() follows the system clock.
+ * In simulated mode time only moves when hal_host_advance_time() (or
+ * hal_delay_ms()) is called.
+ */
+void hal_host_use_simulated_time(uint8_t simulated);
+void hal_host_advance_time(uint32_t ms);
+
+/* Display sink. Every byte sent with spi_send_byte() is counted and
+ * passed to the sink function (if one has been set). The sink can ask 
+ * which device (LED matrix panel) the byte is for.
+ */
+typedef void (*HalHostDisplaySink)(uint8_t byte);
+void hal_host_set_display_sink(HalHostDisplaySink sink);
+uint32_t hal_host_get_display_bytes(void);
+void hal_host_reset_display_bytes(void);
+uint8_t hal_host_get_selected_device(void);
+
+/* Input sources */
+void hal_host_push_button(uint8_t button);
+void hal_host_set_buttons_held(uint8_t buttons);
+void hal_host_set_adc(uint8_t channel, uint16_t value);
+
+/* Outputs */
+uint8_t hal_host_get_lives_shown(void);
+uint16_t hal_host_get_tone_frequency(void);
+
+#endif /* HAL_HOST_H_ */
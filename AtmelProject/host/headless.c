@@ -0,0 +1,128 @@
+/*
+ * headless.c
+ *
+ * Runs the game core (game.c) headless on the host with simulated time.
+ * The lanes move on every ms as in play_game() and the frog makes a
+ * random move every 200ms. Reports how many simulated ticks (ms) were
+ * run per second of host time.
+ *
+ * Usage: headless [simulated_seconds] [seed]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hal_host.h"
+#include "game.h"
+#include "ledmatrix.h"
+#include "score.h"
+#include "timer0.h"
+
+#define MOVE_INTERVAL 200 // ms between random frog moves
+
+static uint32_t random_state;
+
+static uint32_t next_random(void) {
+	// xorshift32
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+static void new_game(void) {
+	init_score();
+	init_lives();
+	init_level();
+	initialise_game();
+}
+
+static void random_move(void) {
+	switch(next_random() % 4) {
+		case 0:
+			if(!frog_has_reached_riverbank()) {
+				move_frog_forward();
+			}
+			break;
+		case 1:
+			move_frog_backward();
+			break;
+		case 2:
+			move_frog_to_left();
+			break;
+		default:
+			move_frog_to_right();
+			break;
+	}
+}
+
+int main(int argc, char** argv) {
+	uint32_t simulated_seconds = argc > 1 ? strtoul(argv[1], NULL, 10) : 3600;
+	uint32_t games = 0, deaths = 0, levels = 0;
+	struct timespec start, end;
+	FILE* report;
+
+	random_state = argc > 2 ? strtoul(argv[2], NULL, 10) : 1;
+	if(random_state == 0) {
+		random_state = 1;
+	}
+
+	// The game writes score/level updates to the terminal (stdout) -
+	// discard those and write our report to the original stdout.
+	report = fdopen(dup(STDOUT_FILENO), "w");
+	if(!report || !freopen("/dev/null", "w", stdout)) {
+		return 1;
+	}
+
+	hal_host_use_simulated_time(1);
+	init_timer0();
+	ledmatrix_setup();
+	new_game();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t tick = 1; tick <= simulated_seconds * 1000; tick++) {
+		hal_host_advance_time(1);
+		uint32_t current_time = get_current_time();
+
+		if(is_frog_dead()) {
+			deaths++;
+			set_lives(get_lives_remaining() - 1);
+			if(get_lives_remaining() == 0) {
+				games++;
+				new_game();
+			} else {
+				put_frog_in_start_position();
+			}
+		} else if(is_riverbank_full()) {
+			levels++;
+			set_level(get_level() + 1);
+			set_lives(get_lives_remaining() + 1);
+			initialise_game();
+		} else if(frog_has_reached_riverbank()) {
+			add_to_score(10);
+			put_frog_in_start_position();
+		}
+
+		if(current_time % MOVE_INTERVAL == 0) {
+			random_move();
+		}
+
+		advance_moving_rows(1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(report, "simulated_ticks %lu\n", (unsigned long)simulated_seconds * 1000);
+	fprintf(report, "host_seconds %.3f\n", elapsed);
+	fprintf(report, "ticks_per_second %.0f\n", simulated_seconds * 1000 / elapsed);
+	fprintf(report, "display_bytes %lu\n", (unsigned long)hal_host_get_display_bytes());
+	fprintf(report, "games %lu deaths %lu levels %lu\n", (unsigned long)games,
+			(unsigned long)deaths, (unsigned long)levels);
+	fclose(report);
+	return 0;
+}
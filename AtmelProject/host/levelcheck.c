@@ -0,0 +1,134 @@
+/*
+ * levelcheck.c
+ *
+ * Validates the level generator (../levelgen.c) over many seeds on the
+ * host. For each seed the given level is generated as in the game - up to
+ * LEVELGEN_MAX_ATTEMPTS layouts are tried until one is solvable. We
+ * report how many layouts were solvable, how many seeds needed more than
+ * one attempt or fell back to a built-in level, and how many seeds were
+ * validated per minute of host time.
+ *
+ * Before that, the solvability check (and the routes to the holes) is
+ * tried on a level which can't be crossed (every traffic lane solid) and
+ * the same level with the lanes clear - build with another board (see
+ * "make boardcheck") to check it on that board.
+ *
+ * Usage: levelcheck [seeds] [level] [first_seed]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "levelgen.h"
+#include "levels.h"
+#include "solver.h"
+
+// Fill in a level with every channel a solid log and every lane either
+// solid with traffic or clear, with a hole in every other column of the
+// riverbank
+static void make_test_level(LevelDescriptor* descriptor, uint8_t lane_pattern) {
+	for(uint8_t i = 0; i < NUM_MOVING_ROWS; i++) {
+		LevelRow* row = &descriptor->rows[i];
+		row->pattern = i < FIRST_CHANNEL_INDEX && !lane_pattern ? 0 : ~(uint64_t)0;
+		row->width = 64;
+		row->direction = (i & 1) ? -1 : 1;
+		row->period = 1000;
+		row->colour = COLOUR_RED;
+		row->fast_start = 0;
+		row->fast_length = 0;
+		row->fast_speed = 0;
+		row->fast_colour = COLOUR_RED;
+	}
+	descriptor->riverbank = 0;
+	for(uint8_t column = 1; column < BOARD_NUM_COLUMNS; column += 2) {
+		descriptor->riverbank |= COLUMN_BIT(column);
+	}
+}
+
+// Return the number of holes reached within the solver's history that no
+// route could be worked back for, after a search
+static uint8_t count_missing_routes(void) {
+	uint8_t moves[SOLVER_HISTORY_STEPS + 1];
+	uint8_t missing = 0;
+	for(uint8_t column = 0; column < BOARD_NUM_COLUMNS; column++) {
+		uint8_t step = solver_get_arrival_step(column);
+		if(step <= SOLVER_HISTORY_STEPS && 
+				solver_get_route_to_hole(column, moves) != step + 1) {
+			missing++;
+		}
+	}
+	return missing;
+}
+
+// Return 1 if the solver finds the clear level solvable, with a route to
+// each hole, and the solid one unsolvable
+static uint8_t check_solver(uint8_t level) {
+	LevelDescriptor descriptor;
+	uint8_t clear_solvable, solid_solvable, missing_routes;
+
+	make_test_level(&descriptor, 0);
+	clear_solvable = is_level_solvable(&descriptor, level);
+	missing_routes = count_missing_routes();
+	make_test_level(&descriptor, 1);
+	solid_solvable = is_level_solvable(&descriptor, level);
+	printf("board %ux%u: clear level %s (%u missing routes), solid level %s\n", 
+			BOARD_NUM_COLUMNS, BOARD_NUM_ROWS, 
+			clear_solvable ? "solvable" : "unsolvable", missing_routes,
+			solid_solvable ? "solvable" : "unsolvable");
+	return clear_solvable && !missing_routes && !solid_solvable;
+}
+
+int main(int argc, char** argv) {
+	uint32_t num_seeds = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+	uint8_t level = argc > 2 ? strtoul(argv[2], NULL, 0) : get_num_level_descriptors() + 1;
+	uint32_t first_seed = argc > 3 ? strtoul(argv[3], NULL, 0) : 0;
+	uint32_t attempt_counts[LEVELGEN_MAX_ATTEMPTS + 1] = { 0 };
+	uint32_t layouts = 0;
+	uint32_t check_sum = 0;
+	struct timespec start, end;
+	LevelDescriptor descriptor;
+
+	if(level <= get_num_level_descriptors()) {
+		fprintf(stderr, "levelcheck: levels 1 to %u are built in\n",
+				get_num_level_descriptors());
+		return 1;
+	}
+	if(!check_solver(level)) {
+		fprintf(stderr, "levelcheck: wrong solvability for the test levels\n");
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(uint32_t i = 0; i < num_seeds; i++) {
+		uint8_t attempts = generate_level_descriptor(level, first_seed + i, &descriptor);
+		attempt_counts[attempts]++;
+		layouts += attempts ? attempts : LEVELGEN_MAX_ATTEMPTS;
+		// Use the result so the work can't be optimised away
+		check_sum += descriptor.riverbank;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double host_seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	uint32_t solved = num_seeds - attempt_counts[0];
+	printf("level %u, seeds %lu to %lu\n", level, (unsigned long)first_seed,
+			(unsigned long)(first_seed + num_seeds - 1));
+	printf("layouts checked:    %lu (%.1f%% solvable)\n", (unsigned long)layouts,
+			layouts ? 100.0 * solved / layouts : 0.0);
+	printf("seeds solved:       %lu (%.4f%%)\n", (unsigned long)solved,
+			num_seeds ? 100.0 * solved / num_seeds : 0.0);
+	for(uint8_t attempts = 1; attempts <= LEVELGEN_MAX_ATTEMPTS; attempts++) {
+		if(attempt_counts[attempts]) {
+			printf("  on attempt %2u:    %lu\n", attempts,
+					(unsigned long)attempt_counts[attempts]);
+		}
+	}
+	printf("built-in fallbacks: %lu\n", (unsigned long)attempt_counts[0]);
+	printf("host seconds:       %.3f\n", host_seconds);
+	printf("seeds per minute:   %.0f\n", num_seeds * 60 / host_seconds);
+	printf("checksum:           %08lx\n", (unsigned long)check_sum);
+	return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * replay.c
+ *
+ * Replays an input log recorded by the game through play_game() with
+ * simulated time and reports the outcome. The log is read from standard
+ * input - everything the game wrote to the serial port while streaming
+ * its log (see ../input.h); only the "#REPLAY" lines are used. Replaying
+ * the same log before and after a change gives identical sessions to
+ * compare.
+ *
+ * Usage: replay < log
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hal_host.h"
+#include "buttons.h"
+#include "game.h"
+#include "input.h"
+#include "joystick.h"
+#include "ledmatrix.h"
+#include "score.h"
+#include "sevenseg.h"
+#include "sound_effects.h"
+#include "timer0.h"
+
+// From project.c
+void new_game(void);
+void play_game(void);
+
+int main(void) {
+	struct timespec start, end;
+	uint32_t start_time;
+	FILE* report;
+	int c;
+
+	while((c = fgetc(stdin)) != EOF) {
+		if(c == '#') {
+			(void)input_load_replay_line();
+		}
+	}
+	if(!input_replay_loaded()) {
+		fprintf(stderr, "replay: no input log found\n");
+		return 1;
+	}
+
+	// The game writes to the terminal (stdout) - discard that and write
+	// our report to the original stdout.
+	report = fdopen(dup(STDOUT_FILENO), "w");
+	if(!report || !freopen("/dev/null", "w", stdout)) {
+		return 1;
+	}
+
+	hal_host_use_simulated_time(1);
+	init_timer0();
+	ledmatrix_setup();
+	init_button_interrupts();
+	init_sevenseg();
+	init_sound_effects();
+	init_joystick();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	new_game();
+	start_time = get_current_time();
+	// Once the log runs out there is no more input (standard input is at
+	// end of file) and the game ends when the frogs run out of time.
+	play_game();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	fprintf(report, "simulated_ms %lu\n", (unsigned long)(get_current_time() - start_time));
+	fprintf(report, "host_seconds %.3f\n", elapsed);
+	fprintf(report, "score %u level %u\n", get_score(), get_level());
+	fprintf(report, "display_bytes %lu\n", (unsigned long)hal_host_get_display_bytes());
+	fclose(report);
+	return 0;
+}
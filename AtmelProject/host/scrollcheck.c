@@ -0,0 +1,109 @@
+/*
+ * scrollcheck.c
+ *
+ * Checks the movement of the prerendered scrolling messages (see
+ * ../scrolling_char_display.h) on the host, with simulated time. A
+ * message is scrolled off the display at each of a set of speeds - whole
+ * and fractional pixels per second, in both directions. After each run of
+ * the scrolling task the window shown should be the one the speed gives
+ * for the time since scrolling started: we show that window ourselves
+ * and check that no display bytes had to be sent to do so. We also check
+ * that something was shown and that the task stopped once the message
+ * had scrolled off.
+ *
+ * Usage: scrollcheck
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "hal_host.h"
+#include "hal.h"
+#include "ledmatrix.h"
+#include "scheduler.h"
+#include "scrolling_char_display.h"
+#include "timer0.h"
+
+// Speeds checked, in 1/SCROLLER_SUBPIXELS pixels per second
+static const int16_t speeds[] = {
+	8 * SCROLLER_SUBPIXELS,
+	-8 * SCROLLER_SUBPIXELS,
+	SCROLLER_SUBPIXELS * 3 / 2,
+	-(SCROLLER_SUBPIXELS * 5 / 2),
+	7,
+	-3
+};
+
+// The time limit (ms) for a message to scroll off
+#define MAX_SCROLL_TIME 600000UL
+
+// Scroll the rendered message at the given speed until it has scrolled
+// off. Returns the number of windows which didn't match the time (plus
+// 1 if the message didn't scroll off or nothing was shown).
+static uint32_t check_speed(int16_t speed, uint16_t length) {
+	// The window starts off the end the message comes in from
+	int16_t start_offset = (speed >= 0) ? -MATRIX_NUM_COLUMNS : length;
+	uint32_t start_time, elapsed = 0;
+	uint32_t mismatches = 0;
+	uint32_t windows = 0;
+	uint32_t bytes_shown = 0;
+
+	ledmatrix_clear();
+	init_scheduler();
+	start_time = get_current_time();
+	if(!scroller_start_rendered(speed, 0)) {
+		printf("speed %d: scroller didn't start\n", speed);
+		return 1;
+	}
+	while(scroller_is_scrolling() && elapsed < MAX_SCROLL_TIME) {
+		hal_host_reset_display_bytes();
+		if(scheduler_run_due()) {
+			bytes_shown += hal_host_get_display_bytes();
+			windows++;
+			// The offset the window should be at - the fraction of a
+			// pixel it has moved is dropped, towards the starting offset
+			elapsed = scheduler_get_time() - start_time;
+			int16_t offset = start_offset + (int32_t)speed * (int32_t)elapsed /
+					((int32_t)SCROLLER_SUBPIXELS * 1000);
+			hal_host_reset_display_bytes();
+			scroller_show_window(offset);
+			if(hal_host_get_display_bytes()) {
+				mismatches++;
+			}
+		}
+		hal_host_advance_time(1);
+	}
+	printf("speed %5d/%d: %lu windows in %lu ms, %lu bytes, %lu wrong\n", speed,
+			SCROLLER_SUBPIXELS, (unsigned long)windows, (unsigned long)elapsed,
+			(unsigned long)bytes_shown, (unsigned long)mismatches);
+	if(scroller_is_scrolling()) {
+		printf("speed %d: message didn't scroll off\n", speed);
+		scroller_stop();
+		return mismatches + 1;
+	}
+	if(!bytes_shown) {
+		printf("speed %d: nothing was shown\n", speed);
+		return mismatches + 1;
+	}
+	return mismatches;
+}
+
+int main(void) {
+	uint32_t failures = 0;
+	uint16_t length = 0;
+
+	hal_host_use_simulated_time(1);
+	ledmatrix_setup();
+	scroller_clear_messages();
+	scroller_queue_message(PSTR("FROG 42"), COLOUR_GREEN, 0);
+	if(!scroller_render()) {
+		printf("message didn't fit in the bitmap\n");
+		return 1;
+	}
+	length = scroller_get_rendered_length();
+
+	for(uint8_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++) {
+		failures += check_speed(speeds[i], length);
+	}
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * solve.c
+ *
+ * Batch analyzer using the solver (../solver.c). For each seed and level
+ * we report the fastest route to each hole in the riverbank from the
+ * start of the level, then play the level through the game module
+ * (game.c) - each frog follows the fastest route the solver finds from
+ * the state of the game at the time, through the move_frog_* functions.
+ * The rows move on as in play_game(), with the frog moving every
+ * SOLVER_STEP_TIME ms. This checks the solver's routes
+ * against the game and gives the best time and score for each level
+ * (ignoring the pauses for sounds and the level transition).
+ *
+ * Results are written as JSON on standard output.
+ *
+ * Usage: solve [levels] [first_seed] [num_seeds]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hal_host.h"
+#include "game.h"
+#include "ledmatrix.h"
+#include "levelgen.h"
+#include "levels.h"
+#include "score.h"
+#include "solver.h"
+
+#define MAX_STEPS (LEVELGEN_TIME_LIMIT / SOLVER_STEP_TIME)
+
+// Simulated time (ms) since the start of the level
+static uint32_t time_now;
+
+// Move simulated time on to the given time, moving the rows
+static void run_until(uint32_t time) {
+	advance_moving_rows(time - time_now);
+	time_now = time;
+}
+
+static void make_move(uint8_t move) {
+	switch(move) {
+		case SOLVER_MOVE_FORWARD:
+			move_frog_forward();
+			break;
+		case SOLVER_MOVE_BACKWARD:
+			move_frog_backward();
+			break;
+		case SOLVER_MOVE_LEFT:
+			move_frog_to_left();
+			break;
+		case SOLVER_MOVE_RIGHT:
+			move_frog_to_right();
+			break;
+	}
+}
+
+// Play the current level, each frog following the fastest route the
+// solver can find. Returns the number of frogs which made it to the
+// riverbank - the level is complete if the riverbank is full.
+static uint8_t play_level(void) {
+	uint8_t moves[SOLVER_HISTORY_STEPS + 1];
+	uint8_t frogs = 0;
+	SolverState state;
+
+	while(!is_riverbank_full()) {
+		solver_read_game_state(&state);
+		if(!solver_search(get_level_descriptor(), &state, MAX_STEPS)) {
+			return frogs;
+		}
+		uint8_t num_moves = solver_get_best_route(moves);
+		uint32_t start_time = time_now;
+		for(uint8_t step = 0; step < num_moves && !is_frog_dead(); step++) {
+			run_until(start_time + step * SOLVER_STEP_TIME);
+			if(!is_frog_dead()) {
+				make_move(moves[step]);
+			}
+		}
+		if(is_frog_dead() || !frog_has_reached_riverbank()) {
+			return frogs;
+		}
+		add_to_score(10);
+		frogs++;
+		put_frog_in_start_position();
+	}
+	return frogs;
+}
+
+static void analyze_level(uint32_t seed, uint8_t level, FILE* report) {
+	SolverState state;
+	RowMask holes;
+	uint16_t score_before;
+	uint8_t frogs;
+	uint8_t first = 1;
+
+	set_level_seed(seed);
+	set_level(level);
+	initialise_game();
+	time_now = 0;
+
+	// Fastest route to each hole from the start of the level
+	solver_start_of_level(get_level_descriptor(), level, &state);
+	holes = ~state.riverbank_status;
+	solver_search(get_level_descriptor(), &state, MAX_STEPS);
+	fprintf(report, "        { \"level\": %u, \"generated\": %s, \"holes\": [",
+			level, level > get_num_level_descriptors() ? "true" : "false");
+	for(uint8_t column = 0; column < BOARD_NUM_COLUMNS; column++) {
+		if((holes >> column) & 1) {
+			uint8_t step = solver_get_arrival_step(column);
+			fprintf(report, "%s{ \"column\": %u, \"fastest_ms\": ", first ? "" : ", ", column);
+			if(step == SOLVER_UNREACHED) {
+				fprintf(report, "null }");
+			} else {
+				fprintf(report, "%lu }", (unsigned long)step * SOLVER_STEP_TIME);
+			}
+			first = 0;
+		}
+	}
+	fprintf(report, "],\n");
+
+	// Play it
+	score_before = get_score();
+	frogs = play_level();
+	fprintf(report, "          \"completed\": %s, \"frogs\": %u, \"level_ms\": %lu, \"score\": %u }",
+			is_riverbank_full() ? "true" : "false", frogs, (unsigned long)time_now,
+			get_score() - score_before);
+}
+
+int main(int argc, char** argv) {
+	uint8_t num_levels = argc > 1 ? strtoul(argv[1], NULL, 0) : 10;
+	uint32_t first_seed = argc > 2 ? strtoul(argv[2], NULL, 0) : 0;
+	uint32_t num_seeds = argc > 3 ? strtoul(argv[3], NULL, 0) : 1;
+	struct timespec start, end;
+	FILE* report;
+
+	// The game writes score/level updates to the terminal (stdout) -
+	// discard those and write our report to the original stdout.
+	report = fdopen(dup(STDOUT_FILENO), "w");
+	if(!report || !freopen("/dev/null", "w", stdout)) {
+		return 1;
+	}
+	ledmatrix_setup();
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	fprintf(report, "{\n  \"seeds\": [\n");
+	for(uint32_t seed = first_seed; seed < first_seed + num_seeds; seed++) {
+		init_score();
+		fprintf(report, "    {\n      \"seed\": %lu,\n      \"levels\": [\n", (unsigned long)seed);
+		for(uint8_t level = 1; level <= num_levels; level++) {
+			analyze_level(seed, level, report);
+			fprintf(report, "%s\n", level < num_levels ? "," : "");
+		}
+		fprintf(report, "      ],\n      \"total_score\": %u\n    }%s\n", get_score(),
+				seed < first_seed + num_seeds - 1 ? "," : "");
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fprintf(report, "  ],\n  \"host_seconds\": %.3f\n}\n",
+			(end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+	fclose(report);
+	return 0;
+}
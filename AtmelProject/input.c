@@ -0,0 +1,432 @@
+/*
+ * input.c
+ *
+ * Game input sources with recording and replay - see input.h
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "hal.h"
+#include "input.h"
+#include "buttons.h"
+#include "joystick.h"
+#include "serialio.h"
+#include "terminalio.h"
+#include "timer0.h"
+
+// ASCII code for Escape character
+#define ESCAPE_CHAR 27
+
+// Log header - magic bytes, version, level, seed (4 bytes)
+#define LOG_MAGIC_0 'F'
+#define LOG_MAGIC_1 'R'
+#define LOG_VERSION 1
+#define LOG_HEADER_SIZE 8
+
+// Event types (top 3 bits of an event's code byte)
+#define EVENT_BUTTON 0
+#define EVENT_KEY 1
+#define EVENT_ESCAPE_KEY 2
+#define EVENT_BUTTONS_HELD 3
+#define EVENT_JOYSTICK 4
+
+// Largest event - 5 byte time, code byte and character
+#define MAX_EVENT_SIZE 7
+
+#ifdef __AVR__
+#define LOG_BUFFER_SIZE 128
+#else
+#define LOG_BUFFER_SIZE 32768
+#endif
+
+// Streamed log lines hold this many bytes and are written from this
+// terminal row
+#define BYTES_PER_LINE 32
+#define LOG_ROW 30
+
+// Replayed button pushes and keys waiting to be returned
+#define REPLAY_QUEUE_SIZE 4
+
+static uint8_t log_buffer[LOG_BUFFER_SIZE];
+static uint16_t log_length;
+
+static uint8_t recording;
+static uint8_t replaying;
+static uint8_t replay_loaded;
+static uint8_t streaming;
+// Set if events were lost because the buffer filled while not streaming
+static uint8_t log_truncated;
+
+// Time (ms) at which recording/replaying started and the time (relative
+// to that) of the last event recorded or the next event to replay
+static uint32_t log_start_time;
+static uint32_t event_time;
+
+// Replay state
+static uint16_t log_position;
+static uint8_t end_of_log;
+static int8_t replayed_buttons[REPLAY_QUEUE_SIZE];
+static uint8_t num_replayed_buttons;
+static int16_t replayed_keys[REPLAY_QUEUE_SIZE];
+static uint8_t num_replayed_keys;
+static uint8_t replayed_buttons_held;
+static uint8_t replayed_joystick_direction;
+
+// Live input state
+static uint8_t characters_into_escape_sequence;
+static uint8_t last_buttons_held;
+static uint8_t last_joystick_direction;
+
+static uint8_t is_log_header(const uint8_t* data) {
+	return data[0] == LOG_MAGIC_0 && data[1] == LOG_MAGIC_1 && data[2] == LOG_VERSION;
+}
+
+////////////////////////////// Recording ///////////////////////////////////
+
+// Write the buffered log to the serial port and empty the buffer
+static void write_log(void) {
+	for(uint16_t i = 0; i < log_length; i++) {
+		if(i % BYTES_PER_LINE == 0) {
+			move_cursor(1, LOG_ROW + i / BYTES_PER_LINE);
+			clear_to_end_of_line();
+			printf_P(PSTR("#REPLAY "));
+		}
+		printf_P(PSTR("%02X"), log_buffer[i]);
+	}
+	if(log_length) {
+		printf_P(PSTR("\n"));
+	}
+	log_length = 0;
+}
+
+static void record_event(uint8_t type, uint8_t value, int16_t character) {
+	if(!recording) {
+		return;
+	}
+	if(log_length > LOG_BUFFER_SIZE - MAX_EVENT_SIZE) {
+		if(!streaming) {
+			// Out of room - the rest of the session can't be recorded
+			log_truncated = 1;
+			recording = 0;
+			return;
+		}
+		write_log();
+	}
+
+	// Time since the previous event, 7 bits at a time
+	uint32_t time = get_current_time() - log_start_time;
+	uint32_t delta = time - event_time;
+	event_time = time;
+	while(delta >= 0x80) {
+		log_buffer[log_length++] = (delta & 0x7F) | 0x80;
+		delta >>= 7;
+	}
+	log_buffer[log_length++] = delta;
+
+	log_buffer[log_length++] = (type << 5) | (value & 0x1F);
+	if(character >= 0) {
+		log_buffer[log_length++] = character;
+	}
+}
+
+void input_start_recording(uint8_t level, uint32_t seed) {
+	log_buffer[0] = LOG_MAGIC_0;
+	log_buffer[1] = LOG_MAGIC_1;
+	log_buffer[2] = LOG_VERSION;
+	log_buffer[3] = level;
+	for(uint8_t i = 0; i < 4; i++) {
+		log_buffer[4 + i] = seed >> (8 * i);
+	}
+	log_length = LOG_HEADER_SIZE;
+	log_truncated = 0;
+	log_start_time = get_current_time();
+	event_time = 0;
+	last_buttons_held = 0;
+	last_joystick_direction = 0;
+	replaying = 0;
+	replay_loaded = 0;
+	recording = 1;
+	if(streaming) {
+		write_log();
+	}
+}
+
+void input_finish_recording(void) {
+	if(recording && streaming) {
+		write_log();
+	}
+	recording = 0;
+}
+
+void input_set_streaming(uint8_t on) {
+	streaming = on;
+	if(streaming && recording) {
+		if(log_truncated) {
+			// The start of the session has been lost
+			move_cursor(1, LOG_ROW);
+			printf_P(PSTR("#REPLAY log truncated\n"));
+		}
+		write_log();
+	}
+}
+
+uint8_t input_is_streaming(void) {
+	return streaming;
+}
+
+////////////////////////////// Replaying ///////////////////////////////////
+
+static int8_t hex_digit_value(int c) {
+	if(c >= '0' && c <= '9') {
+		return c - '0';
+	} else if(c >= 'A' && c <= 'F') {
+		return c - 'A' + 10;
+	} else if(c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+uint8_t input_load_replay_line(void) {
+	const char* tag = PSTR("REPLAY ");
+	uint16_t start = log_length;
+	int c = 0;
+	int8_t high = -1, digit;
+
+	if(!replay_loaded) {
+		start = 0;
+	}
+
+	// Check the tag and read the hex digits up to the end of the line
+	for(uint8_t i = 0; pgm_read_byte(&tag[i]); i++) {
+		c = fgetc(stdin);
+		if(c != pgm_read_byte(&tag[i])) {
+			// Not a replay log line - skip the rest of it
+			while(c != EOF && c != '\n') {
+				c = fgetc(stdin);
+			}
+			return replay_loaded;
+		}
+	}
+	log_length = start;
+	while(c != EOF && c != '\n') {
+		c = fgetc(stdin);
+		digit = hex_digit_value(c);
+		if(digit < 0) {
+			continue;
+		}
+		if(high < 0) {
+			high = digit;
+		} else if(log_length < LOG_BUFFER_SIZE) {
+			log_buffer[log_length++] = (high << 4) | digit;
+			high = -1;
+		} else {
+			log_truncated = 1;
+		}
+	}
+
+	// A new log replaces the one being loaded
+	if(log_length - start >= LOG_HEADER_SIZE && is_log_header(&log_buffer[start])) {
+		memmove(log_buffer, &log_buffer[start], log_length - start);
+		log_length -= start;
+		log_truncated = 0;
+		replay_loaded = 1;
+	} else if(!replay_loaded) {
+		log_length = 0;
+	}
+	recording = 0;
+	return replay_loaded;
+}
+
+uint8_t input_replay_loaded(void) {
+	return replay_loaded;
+}
+
+// Read the next byte of the log being replayed (0 at the end of the log)
+static uint8_t read_log_byte(void) {
+	if(log_position < log_length) {
+		return log_buffer[log_position++];
+	}
+	end_of_log = 1;
+	return 0;
+}
+
+// Read the time of the next event to replay
+static void read_event_time(void) {
+	uint32_t delta = 0;
+	uint8_t shift = 0;
+	uint8_t byte;
+
+	if(log_position >= log_length) {
+		end_of_log = 1;
+		return;
+	}
+	do {
+		byte = read_log_byte();
+		delta |= (uint32_t)(byte & 0x7F) << shift;
+		shift += 7;
+	} while((byte & 0x80) && shift < 32);
+	event_time += delta;
+}
+
+void input_start_replay(uint8_t* level, uint32_t* seed) {
+	*level = log_buffer[3];
+	*seed = 0;
+	for(uint8_t i = 0; i < 4; i++) {
+		*seed |= (uint32_t)log_buffer[4 + i] << (8 * i);
+	}
+	log_position = LOG_HEADER_SIZE;
+	log_start_time = get_current_time();
+	event_time = 0;
+	end_of_log = 0;
+	num_replayed_buttons = 0;
+	num_replayed_keys = 0;
+	replayed_buttons_held = 0;
+	replayed_joystick_direction = 0;
+	recording = 0;
+	replay_loaded = 0;
+	replaying = 1;
+	read_event_time();
+}
+
+uint8_t input_is_replaying(void) {
+	return replaying;
+}
+
+// Apply each replayed event that is now due. The replay finishes once
+// the end of the log has been reached and the game has taken all the
+// replayed button pushes and keys.
+static void replay_due_events(void) {
+	uint32_t time = get_current_time() - log_start_time;
+
+	if(end_of_log && !num_replayed_buttons && !num_replayed_keys) {
+		replaying = 0;
+		return;
+	}
+	while(!end_of_log && (int32_t)(time - event_time) >= 0) {
+		uint8_t code = read_log_byte();
+		uint8_t value = code & 0x1F;
+		switch(code >> 5) {
+			case EVENT_BUTTON:
+				if(num_replayed_buttons < REPLAY_QUEUE_SIZE) {
+					replayed_buttons[num_replayed_buttons++] = value;
+				}
+				break;
+			case EVENT_KEY:
+			case EVENT_ESCAPE_KEY:
+				value = read_log_byte();
+				if(num_replayed_keys < REPLAY_QUEUE_SIZE) {
+					replayed_keys[num_replayed_keys++] =
+							(code >> 5 == EVENT_ESCAPE_KEY ? INPUT_ESCAPE_KEY : 0) | value;
+				}
+				break;
+			case EVENT_BUTTONS_HELD:
+				replayed_buttons_held = value;
+				break;
+			case EVENT_JOYSTICK:
+				replayed_joystick_direction = value;
+				break;
+		}
+		read_event_time();
+	}
+}
+
+//////////////////////////// Input sources /////////////////////////////////
+
+int8_t input_button_pushed(void) {
+	if(replaying) {
+		replay_due_events();
+	}
+	if(replaying) {
+		int8_t button = NO_BUTTON_PUSHED;
+		if(num_replayed_buttons) {
+			button = replayed_buttons[0];
+			num_replayed_buttons--;
+			memmove(replayed_buttons, &replayed_buttons[1], num_replayed_buttons);
+		}
+		return button;
+	}
+
+	int8_t button = button_pushed();
+	if(button != NO_BUTTON_PUSHED) {
+		record_event(EVENT_BUTTON, button, -1);
+	}
+	return button;
+}
+
+int16_t input_key_pressed(void) {
+	if(replaying) {
+		replay_due_events();
+	}
+	if(replaying) {
+		int16_t key = INPUT_NO_KEY;
+		if(num_replayed_keys) {
+			key = replayed_keys[0];
+			num_replayed_keys--;
+			memmove(replayed_keys, &replayed_keys[1], num_replayed_keys * sizeof(int16_t));
+		}
+		return key;
+	}
+
+	if(!serial_input_available()) {
+		return INPUT_NO_KEY;
+	}
+	int c = fgetc(stdin);
+	if(c == EOF) {
+		return INPUT_NO_KEY;
+	}
+	// Serial input may be part of an escape sequence, e.g. ESC [ D
+	// is a left cursor key press.
+	if(characters_into_escape_sequence == 0 && c == ESCAPE_CHAR) {
+		// We've hit the first character in an escape sequence (escape)
+		characters_into_escape_sequence++;
+		return INPUT_NO_KEY;
+	} else if(characters_into_escape_sequence == 1 && c == '[') {
+		// We've hit the second character in an escape sequence
+		characters_into_escape_sequence++;
+		return INPUT_NO_KEY;
+	} else if(characters_into_escape_sequence == 2) {
+		// Third (and last) character in the escape sequence
+		characters_into_escape_sequence = 0;
+		record_event(EVENT_ESCAPE_KEY, 0, (uint8_t)c);
+		return INPUT_ESCAPE_KEY | (uint8_t)c;
+	}
+	// Character was not part of an escape sequence (or we received
+	// an invalid second character in the sequence)
+	characters_into_escape_sequence = 0;
+	record_event(EVENT_KEY, 0, (uint8_t)c);
+	return (uint8_t)c;
+}
+
+uint8_t input_buttons_held(void) {
+	if(replaying) {
+		replay_due_events();
+	}
+	if(replaying) {
+		return replayed_buttons_held;
+	}
+
+	uint8_t buttons = hal_buttons_held();
+	if(buttons != last_buttons_held) {
+		record_event(EVENT_BUTTONS_HELD, buttons, -1);
+		last_buttons_held = buttons;
+	}
+	return buttons;
+}
+
+uint8_t input_joystick_direction(void) {
+	if(replaying) {
+		replay_due_events();
+	}
+	if(replaying) {
+		return replayed_joystick_direction;
+	}
+
+	uint8_t direction = poll_joystick_direction();
+	if(direction != last_joystick_direction) {
+		record_event(EVENT_JOYSTICK, direction, -1);
+		last_joystick_direction = direction;
+	}
+	return direction;
+}
@@ -0,0 +1,81 @@
+/*
+ * input.h
+ *
+ * All of the player's input during a game comes through this module -
+ * push buttons, keys from the serial terminal and the joystick. Each
+ * input can come from the live hardware or from a replay log.
+ *
+ * While recording, every input event is logged with the time (timer0
+ * ticks, i.e. ms since recording started) at which the game received it.
+ * Replaying the log feeds the same events to the game at the same times,
+ * so a recorded session can be reproduced exactly - on the board or in
+ * the host build.
+ *
+ * Log format (all multi-byte values are little endian):
+ *   header: 'F' 'R' version level seed(4 bytes)
+ *   events: time since previous event (ms, 7 bits per byte, bit 7 set if
+ *           more bytes follow), then a code byte. The top 3 bits of the
+ *           code byte are the event type. For keys the character follows
+ *           in the next byte; otherwise the value is in the low 5 bits.
+ *
+ * The log is kept in a small RAM buffer. If streaming is turned on, the
+ * buffer is written to the serial port (as "#REPLAY <hex>" lines) each
+ * time it fills, so sessions of any length can be captured. Otherwise
+ * recording stops when the buffer is full. To replay a log, send the
+ * "#REPLAY" lines back (see input_load_replay_line()). On the board a
+ * replayed log must fit in the buffer; the host build has a large buffer
+ * (see host/replay.c).
+ */
+
+#ifndef INPUT_H_
+#define INPUT_H_
+
+#include <stdint.h>
+
+// Returned by input_key_pressed() for the final character of an escape
+// sequence (e.g. ESC [ A for the cursor up key gives INPUT_ESCAPE_KEY|'A')
+#define INPUT_NO_KEY (-1)
+#define INPUT_ESCAPE_KEY 0x100
+
+// Start recording (discarding any previous log). The level and level
+// seed are recorded in the log header.
+void input_start_recording(uint8_t level, uint32_t seed);
+
+// Write any recorded events not yet streamed to the serial port and
+// stop recording.
+void input_finish_recording(void);
+
+// Turn streaming of the log to the serial port on or off. When turned on,
+// everything recorded so far is written out.
+void input_set_streaming(uint8_t on);
+uint8_t input_is_streaming(void);
+
+// Read the rest of a "#REPLAY <hex>" line from standard input (the '#'
+// has already been read) and add it to the log to be replayed. A line
+// starting with a log header starts a new log. Returns 1 if a log has
+// been loaded and is ready to be replayed.
+uint8_t input_load_replay_line(void);
+
+// Return 1 if a loaded replay is waiting to be started
+uint8_t input_replay_loaded(void);
+
+// Start replaying the loaded log. Live input is ignored until the end of
+// the log is reached. The level and seed from the log header are returned.
+void input_start_replay(uint8_t* level, uint32_t* seed);
+
+// Return 1 while a replay is in progress
+uint8_t input_is_replaying(void);
+
+// Input sources used by the game. These return the live input (recording
+// it if we are recording) or the replayed input.
+// input_button_pushed() - see button_pushed() in buttons.h
+// input_key_pressed() - a character from the serial terminal, decoded
+//   escape sequence or INPUT_NO_KEY
+// input_buttons_held() - see hal_buttons_held() in hal.h
+// input_joystick_direction() - see poll_joystick_direction() in joystick.h
+int8_t input_button_pushed(void);
+int16_t input_key_pressed(void);
+uint8_t input_buttons_held(void);
+uint8_t input_joystick_direction(void);
+
+#endif /* INPUT_H_ */
@@ -6,9 +6,8 @@
 
 #include <stdint.h>
 #include <stdio.h>
-#include <avr/io.h>
-#include <avr/pgmspace.h>
 #include "game.h"
+#include "hal.h"
 
 #define JOYSTICK_IDLE 0
 #define JOYSTICK_UP 1
@@ -21,13 +20,7 @@
 #define JOYSTICK_UP_LEFT 8
 
 void init_joystick(void) {
-	/* Set up ADC - AVCC reference, right adjust */
-	ADMUX = (1<<REFS0);
-	
-	/* Turn on the ADC (but don't start a conversion yet).
-	 * Choose a clock divider of 64.
-	 */
-	ADCSRA = (1<<ADEN)|(1<<ADPS2)|(1<<ADPS1);
+	hal_init_adc();
 }
 
 /* Returns true if the frog has moved given the joystick direction. */
@@ -67,27 +60,11 @@ uint8_t joystick_move(uint8_t joystick_direction) {
 uint8_t poll_joystick_direction(void) {
 	uint16_t x, y; // Current position of the joystick in each axis
 	
-	// Set the ADC mux to ADC0 (left/right direction)
-	ADMUX &= ~1;
-	// Start the ADC conversion
-	ADCSRA |= (1<<ADSC);
-	
-	while (ADCSRA & (1<<ADSC)) {
-		; // Wait until conversion is finished
-	}
-	// Read the value
-	x = ADC;
+	// ADC0 is the left/right direction
+	x = hal_adc_read(0);
 	
-	// Set the ADC mux to ADC1 (up/down direction)
-	ADMUX |= 1;
-	// Start the ADC conversion
-	ADCSRA |= (1<<ADSC);
-	
-	while (ADCSRA & (1<<ADSC)) {
-		; // Wait until conversion is finished
-	}
-	// Read the value
-	y = ADC;
+	// ADC1 is the up/down direction
+	y = hal_adc_read(1);
 	
 	// Convert the x and y values to a joystick direction defined
 	// at the top of this file
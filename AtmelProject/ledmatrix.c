@@ -4,9 +4,31 @@
  * Author: Peter Sutton
  * 
  * See the LED matrix Reference for details of the SPI commands used.
+ *
+ * We keep a shadow copy of what the LED matrix is currently showing.
+ * Update requests are compared against the shadow copy: pixels which
+ * would not change are not sent, and the changed pixels are sent using
+ * whichever command needs the fewest SPI bytes.
+ *
+ * Command bytes are queued for interrupt driven transmission (see
+ * spi.h) so these functions return without waiting for the SPI transfer.
+ * Use ledmatrix_flush() where the display must be up to date before
+ * continuing.
+ *
+ * The display may be made up of several panels (see ledmatrix.h). The
+ * shadow copy covers the whole canvas, and each request is split up by 
+ * panel: a panel is only selected and sent commands if its part of the
+ * request changes what it shows. The commands are the same as for a 
+ * single panel, with coordinates relative to the panel.
+ *
+ * The shadow copy and the rows and columns we are given hold palette 
+ * indices, 4 bits per pixel. Each index is looked up in the palette as
+ * its pixel is queued for the SPI, so the LED matrix is sent the same 
+ * colour bytes as ever. When a palette entry changes colour, the pixels
+ * showing it are sent again as though they had changed.
  */ 
 
-#include <avr/io.h>
+#include "hal.h"
 #include "ledmatrix.h"
 #include "spi.h"
 
@@ -17,100 +39,635 @@
 #define CMD_SHIFT_DISPLAY 0x04
 #define CMD_CLEAR_SCREEN 0x0F
 
+// Number of SPI bytes needed for each command
+#define BYTES_UPDATE_ALL (1 + PANEL_NUM_COLUMNS * PANEL_NUM_ROWS)
+#define BYTES_UPDATE_PIXEL 3
+#define BYTES_UPDATE_ROW (2 + PANEL_NUM_COLUMNS)
+#define BYTES_UPDATE_COL (2 + PANEL_NUM_ROWS)
+#define BYTES_SHIFT 2
+#define BYTES_CLEAR 1
+
+// Position on the canvas of the bottom left pixel of a panel, and the
+// panel showing a given pixel
+#define PANEL_X(panel) (((panel) % LEDMATRIX_PANELS_X) * PANEL_NUM_COLUMNS)
+#define PANEL_Y(panel) (((panel) / LEDMATRIX_PANELS_X) * PANEL_NUM_ROWS)
+#define PANEL_AT(x, y) (((y) / PANEL_NUM_ROWS) * LEDMATRIX_PANELS_X + \
+		(x) / PANEL_NUM_COLUMNS)
+
+// What the LED matrix panels are currently showing
+static MatrixData shadow;
+#define SHADOW_PIXEL(x, y) MATRIX_PIXEL(shadow[y], x)
+#define SET_SHADOW_PIXEL(x, y, pixel) SET_MATRIX_PIXEL(shadow[y], x, pixel)
+
+// The palette, and the number of entries set by ledmatrix_set_palette() 
+// or ledmatrix_palette_index() (the rest are free). While a change of 
+// palette is being sent, stale_colours has a bit set for each entry 
+// which changed.
+static PixelColour palette[LEDMATRIX_PALETTE_SIZE];
+static uint8_t palette_used = 1;
+static uint16_t stale_colours;
+
+// The panel the queued commands are going to (the last one selected)
+static uint8_t selected_panel;
+
+// Display traffic statistics (see ledmatrix.h)
+static uint8_t current_caller;
+static uint32_t command_counts[LEDMATRIX_NUM_COMMAND_TYPES];
+static uint32_t command_bytes[LEDMATRIX_NUM_COMMAND_TYPES];
+static uint32_t caller_counts[LEDMATRIX_NUM_CALLERS];
+static uint32_t caller_bytes[LEDMATRIX_NUM_CALLERS];
+static uint32_t panel_bytes[LEDMATRIX_NUM_PANELS];
+static uint32_t panel_selects;
+
+static void count_command(uint8_t type, uint8_t bytes) {
+	command_counts[type]++;
+	command_bytes[type] += bytes;
+	caller_counts[current_caller]++;
+	caller_bytes[current_caller] += bytes;
+	panel_bytes[selected_panel] += bytes;
+}
+
+// Send the commands which follow to the given panel
+static void select_panel(uint8_t panel) {
+	if(panel != selected_panel) {
+		spi_queue_select(panel);
+		selected_panel = panel;
+		panel_selects++;
+	}
+}
+
+// Of the panels with their bit set in panels (which must not be 0), return
+// the one to send to next. Each panel we move to costs a change of slave
+// select, so we start with the selected panel if it is one of them.
+static uint8_t next_panel(uint8_t panels) {
+	uint8_t panel = 0;
+	if(panels & (1 << selected_panel)) {
+		return selected_panel;
+	}
+	while(!(panels & (1 << panel))) {
+		panel++;
+	}
+	return panel;
+}
+
+// Return 1 if every pixel of the panel is off. (Panels are a whole number
+// of bytes wide in the shadow copy.)
+static uint8_t is_panel_blank(uint8_t panel) {
+	for(uint8_t y = PANEL_Y(panel); y < PANEL_Y(panel) + PANEL_NUM_ROWS; y++) {
+		for(uint8_t i = PANEL_X(panel) / 2; i < (PANEL_X(panel) + PANEL_NUM_COLUMNS) / 2; i++) {
+			if(shadow[y][i]) {
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+// Return 1 if pixel (x, y) must be sent to show the given palette index
+static uint8_t pixel_changed(uint8_t x, uint8_t y, PaletteIndex pixel) {
+	return SHADOW_PIXEL(x, y) != pixel || ((stale_colours >> pixel) & 1);
+}
+
+static void send_pixel(uint8_t x, uint8_t y, PaletteIndex pixel) {
+	select_panel(PANEL_AT(x, y));
+	count_command(LEDMATRIX_CMD_UPDATE_PIXEL, BYTES_UPDATE_PIXEL);
+	spi_queue_byte(CMD_UPDATE_PIXEL);
+	spi_queue_byte( ((y & 0x07)<<4) | (x & 0x0F));
+	spi_queue_byte(palette[pixel]);
+	SET_SHADOW_PIXEL(x, y, pixel);
+}
+
+// The row functions below deal with the part of row y on the panel whose
+// first column is x0
+static void send_row(uint8_t y, MatrixRow row, uint8_t x0) {
+	select_panel(PANEL_AT(x0, y));
+	count_command(LEDMATRIX_CMD_UPDATE_ROW, BYTES_UPDATE_ROW);
+	spi_queue_byte(CMD_UPDATE_ROW);
+	spi_queue_byte(y & 0x07);	// row number
+	for(uint8_t x = x0; x<x0 + PANEL_NUM_COLUMNS; x++) {
+		spi_queue_byte(palette[MATRIX_PIXEL(row, x)]);
+		shadow[y][x >> 1] = row[x >> 1];
+	}
+}
+
+// Return the number of pixels in the part of row y which differ from the 
+// shadow copy
+static uint8_t count_row_changes(uint8_t y, MatrixRow row, uint8_t x0) {
+	uint8_t changes = 0;
+	for(uint8_t x = x0; x<x0 + PANEL_NUM_COLUMNS; x++) {
+		if(pixel_changed(x, y, MATRIX_PIXEL(row, x))) {
+			changes++;
+		}
+	}
+	return changes;
+}
+
+// Send the changed pixels in the part of row y - either as individual 
+// pixel updates or as a whole row, whichever is fewer bytes.
+static void send_row_changes(uint8_t y, MatrixRow row, uint8_t x0, uint8_t changes) {
+	if(changes * BYTES_UPDATE_PIXEL < BYTES_UPDATE_ROW) {
+		for(uint8_t x = x0; x<x0 + PANEL_NUM_COLUMNS; x++) {
+			if(pixel_changed(x, y, MATRIX_PIXEL(row, x))) {
+				send_pixel(x, y, MATRIX_PIXEL(row, x));
+			}
+		}
+	} else {
+		send_row(y, row, x0);
+	}
+}
+
+// As for the row functions, for the part of column x on the panel whose 
+// first row is y0
+static uint8_t count_column_changes(uint8_t x, MatrixColumn col, uint8_t y0) {
+	uint8_t changes = 0;
+	for(uint8_t y = y0; y<y0 + PANEL_NUM_ROWS; y++) {
+		if(pixel_changed(x, y, MATRIX_PIXEL(col, y))) {
+			changes++;
+		}
+	}
+	return changes;
+}
+
+static void send_column_changes(uint8_t x, MatrixColumn col, uint8_t y0, uint8_t changes) {
+	if(changes * BYTES_UPDATE_PIXEL < BYTES_UPDATE_COL) {
+		for(uint8_t y = y0; y<y0 + PANEL_NUM_ROWS; y++) {
+			if(pixel_changed(x, y, MATRIX_PIXEL(col, y))) {
+				send_pixel(x, y, MATRIX_PIXEL(col, y));
+			}
+		}
+		return;
+	}
+	select_panel(PANEL_AT(x, y0));
+	count_command(LEDMATRIX_CMD_UPDATE_COL, BYTES_UPDATE_COL);
+	spi_queue_byte(CMD_UPDATE_COL);
+	spi_queue_byte(x & 0x0F); // column number
+	for(uint8_t y = y0; y<y0 + PANEL_NUM_ROWS; y++) {
+		spi_queue_byte(palette[MATRIX_PIXEL(col, y)]);
+		SET_SHADOW_PIXEL(x, y, MATRIX_PIXEL(col, y));
+	}
+}
+
+// The new pixels for ledmatrix_update_rows() - num_rows rows from row y0.
+// The other rows are unchanged.
+typedef struct {
+	const MatrixRow* rows;
+	uint8_t y0;
+	uint8_t num_rows;
+} Update;
+
+static PaletteIndex new_pixel(const Update* update, uint8_t x, uint8_t y) {
+	if(y >= update->y0 && y - update->y0 < update->num_rows) {
+		return MATRIX_PIXEL(update->rows[y - update->y0], x);
+	}
+	return SHADOW_PIXEL(x, y);
+}
+
+// Work out the cost (bytes) of sending just the changed rows/pixels of 
+// a panel. The number of changes in each of its rows is returned in 
+// changes.
+static uint16_t count_panel_changes(uint8_t panel, const Update* update, 
+		uint8_t changes[PANEL_NUM_ROWS]) {
+	uint16_t bytes_needed = 0;
+	for(uint8_t j=0; j<PANEL_NUM_ROWS; j++) {
+		uint8_t y = PANEL_Y(panel) + j;
+		changes[j] = 0;
+		for(uint8_t x=PANEL_X(panel); x<PANEL_X(panel) + PANEL_NUM_COLUMNS; x++) {
+			if(pixel_changed(x, y, new_pixel(update, x, y))) {
+				changes[j]++;
+			}
+		}
+		if(changes[j] * BYTES_UPDATE_PIXEL < BYTES_UPDATE_ROW) {
+			bytes_needed += changes[j] * BYTES_UPDATE_PIXEL;
+		} else {
+			bytes_needed += BYTES_UPDATE_ROW;
+		}
+	}
+	return bytes_needed;
+}
+
+// Bring a panel up to date, sending the changed rows/pixels or the whole
+// panel, whichever is fewer bytes
+static void send_panel_changes(uint8_t panel, const Update* update) {
+	uint8_t changes[PANEL_NUM_ROWS];
+	uint8_t x0 = PANEL_X(panel);
+	uint8_t y0 = PANEL_Y(panel);
+	
+	if(count_panel_changes(panel, update, changes) < BYTES_UPDATE_ALL) {
+		for(uint8_t j=0; j<PANEL_NUM_ROWS; j++) {
+			if(changes[j] == 0) {
+				continue;
+			}
+			MatrixRow row;
+			for(uint8_t x=x0; x<x0 + PANEL_NUM_COLUMNS; x++) {
+				SET_MATRIX_PIXEL(row, x, new_pixel(update, x, y0 + j));
+			}
+			send_row_changes(y0 + j, row, x0, changes[j]);
+		}
+		return;
+	}
+	
+	select_panel(panel);
+	count_command(LEDMATRIX_CMD_UPDATE_ALL, BYTES_UPDATE_ALL);
+	spi_queue_byte(CMD_UPDATE_ALL);
+	for(uint8_t y=y0; y<y0 + PANEL_NUM_ROWS; y++) {
+		for(uint8_t x=x0; x<x0 + PANEL_NUM_COLUMNS; x++) {
+			PaletteIndex pixel = new_pixel(update, x, y);
+			spi_queue_byte(palette[pixel]);
+			SET_SHADOW_PIXEL(x, y, pixel);
+		}
+	}
+}
+
+// Shift the shadow copy of a panel in the same way as the panel. dx and dy
+// are -1, 0 or 1. The row or column shifted in is blank.
+static void shift_panel_shadow(uint8_t panel, int8_t dx, int8_t dy) {
+	for(uint8_t i = 0; i<PANEL_NUM_COLUMNS; i++) {
+		// Work from the side we are shifting towards so we don't
+		// overwrite pixels before they are moved
+		int8_t x = (dx > 0) ? PANEL_NUM_COLUMNS - 1 - i : i;
+		for(uint8_t j = 0; j<PANEL_NUM_ROWS; j++) {
+			int8_t y = (dy > 0) ? PANEL_NUM_ROWS - 1 - j : j;
+			int8_t from_x = x - dx;
+			int8_t from_y = y - dy;
+			PaletteIndex pixel = 0;
+			if(from_x >= 0 && from_x < PANEL_NUM_COLUMNS &&
+					from_y >= 0 && from_y < PANEL_NUM_ROWS) {
+				pixel = SHADOW_PIXEL(PANEL_X(panel) + from_x, PANEL_Y(panel) + from_y);
+			}
+			SET_SHADOW_PIXEL(PANEL_X(panel) + x, PANEL_Y(panel) + y, pixel);
+		}
+	}
+}
+
+// Shift the whole display one place. dx and dy are -1, 0 or 1 and 
+// direction is the argument of the shift command. Each panel which isn't
+// blank is sent the shift command, then the row or column shifted into
+// it from the neighbouring panel (if any) is sent. The panels are shifted
+// in turn, away from the direction of the shift, so that each neighbour
+// still holds the pixels to be moved across.
+static void shift_display(int8_t dx, int8_t dy, uint8_t direction) {
+	for(uint8_t i = 0; i < LEDMATRIX_NUM_PANELS; i++) {
+		uint8_t panel = (dx > 0 || dy > 0) ? LEDMATRIX_NUM_PANELS - 1 - i : i;
+		uint8_t x0 = PANEL_X(panel);
+		uint8_t y0 = PANEL_Y(panel);
+		uint8_t changes;
+		
+		if(!is_panel_blank(panel)) {
+			select_panel(panel);
+			count_command(LEDMATRIX_CMD_SHIFT, BYTES_SHIFT);
+			spi_queue_byte(CMD_SHIFT_DISPLAY);
+			spi_queue_byte(direction);
+			shift_panel_shadow(panel, dx, dy);
+		}
+		
+		if(dx) {
+			// The edge column and the neighbour's column it comes from
+			uint8_t x = (dx < 0) ? x0 + PANEL_NUM_COLUMNS - 1 : x0;
+			int8_t from_x = x - dx;
+			MatrixColumn col;
+			for(uint8_t y = y0; y<y0 + PANEL_NUM_ROWS; y++) {
+				SET_MATRIX_PIXEL(col, y, (from_x >= 0 && from_x < MATRIX_NUM_COLUMNS) ? 
+						SHADOW_PIXEL(from_x, y) : 0);
+			}
+			changes = count_column_changes(x, col, y0);
+			if(changes) {
+				send_column_changes(x, col, y0, changes);
+			}
+		} else {
+			uint8_t y = (dy > 0) ? y0 : y0 + PANEL_NUM_ROWS - 1;
+			int8_t from_y = y - dy;
+			MatrixRow row;
+			for(uint8_t x = x0; x<x0 + PANEL_NUM_COLUMNS; x++) {
+				SET_MATRIX_PIXEL(row, x, (from_y >= 0 && from_y < MATRIX_NUM_ROWS) ? 
+						SHADOW_PIXEL(x, from_y) : 0);
+			}
+			changes = count_row_changes(y, row, x0);
+			if(changes) {
+				send_row_changes(y, row, x0, changes);
+			}
+		}
+	}
+}
+
 void ledmatrix_setup(void) {
 	// Setup SPI - we divide the clock by 128.
 	// (This speed guarantees the SPI buffer will never overflow on
 	// the LED matrix.)
 	spi_setup_master(128);
+	selected_panel = 0;
+	
+	// Clear the display so we know it matches our (blank) shadow copy
+	for(uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		select_panel(panel);
+		count_command(LEDMATRIX_CMD_CLEAR, BYTES_CLEAR);
+		spi_queue_byte(CMD_CLEAR_SCREEN);
+	}
+	for(uint8_t y=0; y<MATRIX_NUM_ROWS; y++) {
+		set_matrix_row_to_colour(shadow[y], 0);
+	}
 }
 
-void ledmatrix_update_all(MatrixData data) {
-	(void)spi_send_byte(CMD_UPDATE_ALL);
-	for(uint8_t y=0; y<MATRIX_NUM_ROWS; y++) {
-		for(uint8_t x=0; x<MATRIX_NUM_COLUMNS; x++) {
-			(void)spi_send_byte(data[x][y]);
+// Bring every panel up to date with the update, sending nothing to the
+// panels which don't change
+static void send_update(const Update* update) {
+	uint8_t changes[PANEL_NUM_ROWS];
+	uint8_t panels = 0;
+	for(uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		if(count_panel_changes(panel, update, changes)) {
+			panels |= (1 << panel);
 		}
 	}
+	while(panels) {
+		uint8_t panel = next_panel(panels);
+		panels &= ~(1 << panel);
+		send_panel_changes(panel, update);
+	}
+}
+
+void ledmatrix_update_all(MatrixData data) {
+	Update update = { data, 0, MATRIX_NUM_ROWS };
+	send_update(&update);
+}
+
+void ledmatrix_update_rows(uint8_t y, uint8_t num_rows, const MatrixRow* rows) {
+	if(y >= MATRIX_NUM_ROWS) {
+		// y value is too large - we ignore the request
+		return;
+	}
+	if(num_rows > MATRIX_NUM_ROWS - y) {
+		num_rows = MATRIX_NUM_ROWS - y;
+	}
+	Update update = { rows, y, num_rows };
+	send_update(&update);
 }
 
-void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel) {
-	if(x >= MATRIX_NUM_COLUMNS || y >= MATRIX_NUM_ROWS) {
-		// Position isn't valid - we ignore the request.
+void ledmatrix_update_pixel(uint8_t x, uint8_t y, PaletteIndex pixel) {
+	if(x >= MATRIX_NUM_COLUMNS || y >= MATRIX_NUM_ROWS || pixel >= LEDMATRIX_PALETTE_SIZE) {
+		// Position or colour isn't valid - we ignore the request.
+		return;
+	}
+	if(SHADOW_PIXEL(x, y) == pixel) {
+		// Pixel is already showing this colour
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_PIXEL);
-	(void)spi_send_byte( ((y & 0x07)<<4) | (x & 0x0F));
-	(void)spi_send_byte(pixel);
+	send_pixel(x, y, pixel);
 }
 
 void ledmatrix_update_row(uint8_t y, MatrixRow row) {
+	uint8_t changes[LEDMATRIX_PANELS_X];
+	uint8_t panels = 0;
 	if(y >= MATRIX_NUM_ROWS) {
 		// y value is too large - we ignore the request
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_ROW);
-	(void)spi_send_byte(y & 0x07);	// row number
-	for(uint8_t x = 0; x<MATRIX_NUM_COLUMNS; x++) {
-		(void)spi_send_byte(row[x]);
+	for(uint8_t i = 0; i < LEDMATRIX_PANELS_X; i++) {
+		changes[i] = count_row_changes(y, row, i * PANEL_NUM_COLUMNS);
+		if(changes[i]) {
+			panels |= (1 << PANEL_AT(i * PANEL_NUM_COLUMNS, y));
+		}
+	}
+	while(panels) {
+		uint8_t panel = next_panel(panels);
+		panels &= ~(1 << panel);
+		send_row_changes(y, row, PANEL_X(panel), 
+				changes[panel % LEDMATRIX_PANELS_X]);
 	}
 }
 
 void ledmatrix_update_column(uint8_t x, MatrixColumn col) {
+	uint8_t changes[LEDMATRIX_PANELS_Y];
+	uint8_t panels = 0;
 	if(x >= MATRIX_NUM_COLUMNS) {
 		// x value is too large - we ignore the request
 		return;
 	}
-	(void)spi_send_byte(CMD_UPDATE_COL);
-	(void)spi_send_byte(x & 0x0F); // column number
-	for(uint8_t y = 0; y<MATRIX_NUM_ROWS; y++) {
-		(void)spi_send_byte(col[y]);
+	for(uint8_t i = 0; i < LEDMATRIX_PANELS_Y; i++) {
+		changes[i] = count_column_changes(x, col, i * PANEL_NUM_ROWS);
+		if(changes[i]) {
+			panels |= (1 << PANEL_AT(x, i * PANEL_NUM_ROWS));
+		}
+	}
+	while(panels) {
+		uint8_t panel = next_panel(panels);
+		panels &= ~(1 << panel);
+		send_column_changes(x, col, PANEL_Y(panel), 
+				changes[panel / LEDMATRIX_PANELS_X]);
 	}
 }
 
+// The shift commands move every pixel one place in the given direction.
+// We assume the row or column shifted in is blank.
 void ledmatrix_shift_display_left(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x02);
+	shift_display(-1, 0, 0x02);
 }
 
 void ledmatrix_shift_display_right(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x01);
+	shift_display(1, 0, 0x01);
 }
 
 void ledmatrix_shift_display_up(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x08);
+	shift_display(0, 1, 0x08);
 }
 
 void ledmatrix_shift_display_down(void) {
-	(void)spi_send_byte(CMD_SHIFT_DISPLAY);
-	(void)spi_send_byte(0x04);
+	shift_display(0, -1, 0x04);
 }
 
 void ledmatrix_clear(void) {
-	(void)spi_send_byte(CMD_CLEAR_SCREEN);
+	uint8_t panels = 0;
+	for(uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		if(!is_panel_blank(panel)) {
+			panels |= (1 << panel);
+		}
+	}
+	while(panels) {
+		uint8_t panel = next_panel(panels);
+		panels &= ~(1 << panel);
+		select_panel(panel);
+		count_command(LEDMATRIX_CMD_CLEAR, BYTES_CLEAR);
+		spi_queue_byte(CMD_CLEAR_SCREEN);
+		for(uint8_t y = PANEL_Y(panel); y < PANEL_Y(panel) + PANEL_NUM_ROWS; y++) {
+			for(uint8_t i = PANEL_X(panel) / 2; i < (PANEL_X(panel) + PANEL_NUM_COLUMNS) / 2; i++) {
+				shadow[y][i] = 0;
+			}
+		}
+	}
+}
+
+// Set palette entry index to the given colour. Returns 1 if it changed.
+static uint8_t set_palette_entry(PaletteIndex index, PixelColour colour) {
+	if(palette[index] == colour) {
+		return 0;
+	}
+	palette[index] = colour;
+	return 1;
+}
+
+// Send again the pixels showing the palette entries with their bit set in
+// colours
+static void send_palette_changes(uint16_t colours) {
+	if(colours) {
+		Update no_change = { 0, 0, 0 };
+		stale_colours = colours;
+		send_update(&no_change);
+		stale_colours = 0;
+	}
+}
+
+void ledmatrix_set_palette(const PixelColour* colours, uint8_t num_colours) {
+	uint16_t changed = 0;
+	if(num_colours > LEDMATRIX_PALETTE_SIZE) {
+		num_colours = LEDMATRIX_PALETTE_SIZE;
+	}
+	// Entry 0 stays black
+	for(PaletteIndex i = 1; i < num_colours; i++) {
+		if(set_palette_entry(i, colours[i])) {
+			changed |= (1 << i);
+		}
+	}
+	palette_used = num_colours ? num_colours : 1;
+	send_palette_changes(changed);
+}
+
+PaletteIndex ledmatrix_palette_index(PixelColour colour) {
+	for(PaletteIndex i = 0; i < palette_used; i++) {
+		if(palette[i] == colour) {
+			return i;
+		}
+	}
+	if(palette_used == LEDMATRIX_PALETTE_SIZE) {
+		return 0;
+	}
+	if(set_palette_entry(palette_used, colour)) {
+		send_palette_changes(1 << palette_used);
+	}
+	return palette_used++;
+}
+
+void ledmatrix_set_palette_colour(PaletteIndex index, PixelColour colour) {
+	if(index == 0 || index >= LEDMATRIX_PALETTE_SIZE) {
+		return;
+	}
+	if(set_palette_entry(index, colour)) {
+		send_palette_changes(1 << index);
+	}
+}
+
+PixelColour ledmatrix_get_palette_colour(PaletteIndex index) {
+	return palette[index];
+}
+
+uint8_t ledmatrix_get_palette_size(void) {
+	return palette_used;
+}
+
+void ledmatrix_flush(void) {
+	spi_flush();
+}
+
+uint8_t ledmatrix_set_caller(uint8_t new_caller) {
+	uint8_t previous_caller = current_caller;
+	if(new_caller < LEDMATRIX_NUM_CALLERS) {
+		current_caller = new_caller;
+	}
+	return previous_caller;
+}
+
+uint32_t ledmatrix_get_command_count(uint8_t type) {
+	return command_counts[type];
+}
+
+uint32_t ledmatrix_get_command_bytes(uint8_t type) {
+	return command_bytes[type];
+}
+
+const char* ledmatrix_get_command_name(uint8_t type) {
+	switch(type) {
+		case LEDMATRIX_CMD_UPDATE_ALL:
+			return PSTR("update all");
+		case LEDMATRIX_CMD_UPDATE_PIXEL:
+			return PSTR("pixel");
+		case LEDMATRIX_CMD_UPDATE_ROW:
+			return PSTR("row");
+		case LEDMATRIX_CMD_UPDATE_COL:
+			return PSTR("column");
+		case LEDMATRIX_CMD_SHIFT:
+			return PSTR("shift");
+		default:
+			return PSTR("clear");
+	}
+}
+
+uint32_t ledmatrix_get_caller_count(uint8_t caller) {
+	return caller_counts[caller];
+}
+
+uint32_t ledmatrix_get_caller_bytes(uint8_t caller) {
+	return caller_bytes[caller];
+}
+
+const char* ledmatrix_get_caller_name(uint8_t caller) {
+	switch(caller) {
+		case LEDMATRIX_CALLER_GAME:
+			return PSTR("game");
+		case LEDMATRIX_CALLER_SCROLLER:
+			return PSTR("scroller");
+		default:
+			return PSTR("transition");
+	}
+}
+
+uint32_t ledmatrix_get_blocked_time(void) {
+	return spi_get_blocked_time();
+}
+
+uint32_t ledmatrix_get_panel_bytes(uint8_t panel) {
+	return panel_bytes[panel];
+}
+
+uint32_t ledmatrix_get_panel_selects(void) {
+	return panel_selects;
+}
+
+void ledmatrix_reset_stats(void) {
+	for(uint8_t type = 0; type < LEDMATRIX_NUM_COMMAND_TYPES; type++) {
+		command_counts[type] = 0;
+		command_bytes[type] = 0;
+	}
+	for(uint8_t i = 0; i < LEDMATRIX_NUM_CALLERS; i++) {
+		caller_counts[i] = 0;
+		caller_bytes[i] = 0;
+	}
+	for(uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		panel_bytes[panel] = 0;
+	}
+	panel_selects = 0;
+	spi_reset_blocked_time();
 }
 
+// These work on the packed bytes, two pixels at a time
 void copy_matrix_column(MatrixColumn from, MatrixColumn to) {
-	for(uint8_t row = 0; row <MATRIX_NUM_ROWS; row++) {
-		to[row] = from[row];
+	for(uint8_t i = 0; i < MATRIX_NUM_ROWS / 2; i++) {
+		to[i] = from[i];
 	}
 }
 
 void copy_matrix_row(MatrixRow from, MatrixRow to) {
-	for(uint8_t col = 0; col < MATRIX_NUM_COLUMNS; col++) {
-		to[col] = from[col];
+	for(uint8_t i = 0; i < MATRIX_NUM_COLUMNS / 2; i++) {
+		to[i] = from[i];
 	}
 }
 
-void set_matrix_column_to_colour(MatrixColumn matrix_column, PixelColour colour) {
-	for(uint8_t row = 0; row < MATRIX_NUM_ROWS; row++) {
-		matrix_column[row] = colour;
+void set_matrix_column_to_colour(MatrixColumn matrix_column, PaletteIndex colour) {
+	colour &= 0x0F;
+	for(uint8_t i = 0; i < MATRIX_NUM_ROWS / 2; i++) {
+		matrix_column[i] = colour | (colour << 4);
 	}
 }
 
-void set_matrix_row_to_colour(MatrixRow matrix_row, PixelColour colour) {
-	for(uint8_t column = 0; column < MATRIX_NUM_COLUMNS; column++) {
-		matrix_row[column] = colour;
+void set_matrix_row_to_colour(MatrixRow matrix_row, PaletteIndex colour) {
+	colour &= 0x0F;
+	for(uint8_t i = 0; i < MATRIX_NUM_COLUMNS / 2; i++) {
+		matrix_row[i] = colour | (colour << 4);
 	}
 }
@@ -11,15 +11,54 @@
 #include <stdint.h>
 #include "pixel_colour.h"
 
-// The matrix has 16 columns (x ranges from 0 to 15, left to right) and 
-// 8 rows (y ranges from 0 to 7, bottom to top)
-#define MATRIX_NUM_COLUMNS 16
-#define MATRIX_NUM_ROWS 8
+// Each LED matrix panel has 16 columns and 8 rows. The display can be 
+// made up of one panel, two side by side (32x8), two stacked (16x16) or 
+// four (32x16) - set LEDMATRIX_PANELS_X and LEDMATRIX_PANELS_Y on the 
+// compiler command line (e.g. -DLEDMATRIX_PANELS_X=2). The functions 
+// below draw on the whole display (the canvas): x ranges from 0 to 
+// MATRIX_NUM_COLUMNS-1, left to right, and y from 0 to MATRIX_NUM_ROWS-1,
+// bottom to top.
+// The panels share the SPI bus, each with its own slave select - panel n 
+// is SPI device n (see spi.h). Panels are numbered from the bottom left,
+// left to right and then upwards.
+#define PANEL_NUM_COLUMNS 16
+#define PANEL_NUM_ROWS 8
+#ifndef LEDMATRIX_PANELS_X
+#define LEDMATRIX_PANELS_X 1
+#endif
+#ifndef LEDMATRIX_PANELS_Y
+#define LEDMATRIX_PANELS_Y 1
+#endif
+#if LEDMATRIX_PANELS_X < 1 || LEDMATRIX_PANELS_X > 2 || \
+		LEDMATRIX_PANELS_Y < 1 || LEDMATRIX_PANELS_Y > 2
+#error "The LED matrix must be 1 or 2 panels wide and 1 or 2 panels high"
+#endif
+#define LEDMATRIX_NUM_PANELS (LEDMATRIX_PANELS_X * LEDMATRIX_PANELS_Y)
 
-// Data types which can be used to store display information
-typedef PixelColour MatrixData[MATRIX_NUM_COLUMNS][MATRIX_NUM_ROWS];
-typedef PixelColour MatrixRow[MATRIX_NUM_COLUMNS];
-typedef PixelColour MatrixColumn[MATRIX_NUM_ROWS];
+#define MATRIX_NUM_COLUMNS (PANEL_NUM_COLUMNS * LEDMATRIX_PANELS_X)
+#define MATRIX_NUM_ROWS (PANEL_NUM_ROWS * LEDMATRIX_PANELS_Y)
+
+// Pixels are drawn as indices into a palette of LEDMATRIX_PALETTE_SIZE
+// colours, which are only turned into colours (see pixel_colour.h) as they
+// are sent to the LED matrix. Entry 0 is always black - the display is 
+// cleared to it, and blank rows and columns are shifted in.
+#define LEDMATRIX_PALETTE_SIZE 16
+typedef uint8_t PaletteIndex;
+
+// Data types which can be used to store display information. Each pixel 
+// is a 4 bit palette index, two to a byte - the even numbered pixel of 
+// each pair in the low bits. A MatrixData is the rows of the display from
+// the bottom up.
+typedef uint8_t MatrixRow[MATRIX_NUM_COLUMNS / 2];
+typedef uint8_t MatrixColumn[MATRIX_NUM_ROWS / 2];
+typedef MatrixRow MatrixData[MATRIX_NUM_ROWS];
+
+// Pixel i of a row or column (the arguments may be evaluated more than 
+// once)
+#define MATRIX_PIXEL(data, i) (((data)[(i) >> 1] >> (((i) & 1) << 2)) & 0x0F)
+#define SET_MATRIX_PIXEL(data, i, index) ((data)[(i) >> 1] = ((i) & 1) ? \
+		(((data)[(i) >> 1] & 0x0F) | (((index) & 0x0F) << 4)) : \
+		(((data)[(i) >> 1] & 0xF0) | ((index) & 0x0F)))
 
 // Setup SPI communication with the LED matrix.
 // This function must be called before the LED matrix functions
@@ -30,8 +69,19 @@ void ledmatrix_setup(void);
 // For those functions which take an x or a y value, the value must be valid
 // or the request will be ignored. (i.e. x must be < MATRIX_NUM_COLUMNS
 // and y must be < MATRIX_NUM_ROWS)
+// Only the pixels which differ from what is currently displayed are sent
+// to the LED matrix, using the command which needs the fewest bytes. 
+// Panels with no changes are not sent anything, and the panels which 
+// change are sent their commands one after the other (starting with the
+// panel already selected), so the slave select changes as few times as 
+// possible.
 void ledmatrix_update_all(MatrixData data);
-void ledmatrix_update_pixel(uint8_t x, uint8_t y, PixelColour pixel);
+// Update num_rows rows at once, starting from row y (rows[0] is row y).
+// Rows past the top of the display are ignored. Where it is fewer bytes,
+// a panel is sent a single whole display update rather than row and 
+// pixel updates.
+void ledmatrix_update_rows(uint8_t y, uint8_t num_rows, const MatrixRow* rows);
+void ledmatrix_update_pixel(uint8_t x, uint8_t y, PaletteIndex pixel);
 void ledmatrix_update_row(uint8_t y, MatrixRow row);
 void ledmatrix_update_column(uint8_t x, MatrixColumn col);
 void ledmatrix_shift_display_left(void);
@@ -40,10 +90,67 @@ void ledmatrix_shift_display_up(void);
 void ledmatrix_shift_display_down(void);
 void ledmatrix_clear(void);
 
+// Set palette entries 0 to num_colours-1 to the given colours (colours[0]
+// must be black). The entries after them are free for 
+// ledmatrix_palette_index() to use. Pixels already on the display in an 
+// entry which changes colour are sent again in the new colour.
+void ledmatrix_set_palette(const PixelColour* colours, uint8_t num_colours);
+// Return the palette entry with the given colour. If there isn't one, the
+// colour is put in the next free entry - or if there are none left, 0
+// (black) is returned.
+PaletteIndex ledmatrix_palette_index(PixelColour colour);
+// Change the colour of one palette entry (1 to LEDMATRIX_PALETTE_SIZE-1) 
+// - e.g. to make the pixels drawn in it flash
+void ledmatrix_set_palette_colour(PaletteIndex index, PixelColour colour);
+PixelColour ledmatrix_get_palette_colour(PaletteIndex index);
+// Number of palette entries in use (see ledmatrix_set_palette())
+uint8_t ledmatrix_get_palette_size(void);
+
+// The functions above queue their SPI bytes and return immediately.
+// ledmatrix_flush() waits until everything queued has been sent to the
+// LED matrix.
+void ledmatrix_flush(void);
+
+// Display traffic statistics. Each command sent to the LED matrix is
+// counted (with its size in bytes) against its type and against the
+// current caller - the part of the program drawing on the display.
+#define LEDMATRIX_CMD_UPDATE_ALL 0
+#define LEDMATRIX_CMD_UPDATE_PIXEL 1
+#define LEDMATRIX_CMD_UPDATE_ROW 2
+#define LEDMATRIX_CMD_UPDATE_COL 3
+#define LEDMATRIX_CMD_SHIFT 4
+#define LEDMATRIX_CMD_CLEAR 5
+#define LEDMATRIX_NUM_COMMAND_TYPES 6
+
+#define LEDMATRIX_CALLER_GAME 0
+#define LEDMATRIX_CALLER_SCROLLER 1
+#define LEDMATRIX_CALLER_TRANSITION 2
+#define LEDMATRIX_NUM_CALLERS 3
+
+// Set the caller that commands are counted against (initially
+// LEDMATRIX_CALLER_GAME). Returns the previous caller so that it can be
+// restored.
+uint8_t ledmatrix_set_caller(uint8_t caller);
+
+// Statistics since they were last reset. The names are strings in 
+// program memory.
+uint32_t ledmatrix_get_command_count(uint8_t type);
+uint32_t ledmatrix_get_command_bytes(uint8_t type);
+const char* ledmatrix_get_command_name(uint8_t type);
+uint32_t ledmatrix_get_caller_count(uint8_t caller);
+uint32_t ledmatrix_get_caller_bytes(uint8_t caller);
+const char* ledmatrix_get_caller_name(uint8_t caller);
+// Time (us) spent waiting for the SPI queue (see spi_get_blocked_time())
+uint32_t ledmatrix_get_blocked_time(void);
+// Bytes sent to each panel, and the number of times we switched panels
+uint32_t ledmatrix_get_panel_bytes(uint8_t panel);
+uint32_t ledmatrix_get_panel_selects(void);
+void ledmatrix_reset_stats(void);
+
 // Functions to operate on rows and columns
 void copy_matrix_column(MatrixColumn from, MatrixColumn to);
 void copy_matrix_row(MatrixRow from, MatrixRow to);
-void set_matrix_column_to_colour(MatrixColumn matrix_column, PixelColour colour);
-void set_matrix_row_to_colour(MatrixRow matrix_row, PixelColour colour);
+void set_matrix_column_to_colour(MatrixColumn matrix_column, PaletteIndex colour);
+void set_matrix_row_to_colour(MatrixRow matrix_row, PaletteIndex colour);
 
 #endif /* LEDMATRIX_H_ */
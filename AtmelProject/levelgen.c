@@ -0,0 +1,185 @@
+/*
+ * levelgen.c
+ *
+ * Level generator and solvability check - see levelgen.h
+ */
+
+#include <stdint.h>
+
+#include "entities.h"
+#include "hal.h"
+#include "levelgen.h"
+#include "levels.h"
+#include "playfield.h"
+#include "solver.h"
+
+// Ranges for the generated rows. Lengths and gaps are in columns, periods
+// in ms (on level 1).
+#define LANE_WIDTH 64
+#define VEHICLE_MIN_LENGTH 1
+#define VEHICLE_MAX_LENGTH 4
+#define VEHICLE_MIN_GAP 2
+#define VEHICLE_MAX_GAP 6
+#define LANE_MIN_PERIOD 650
+#define LANE_PERIOD_STEPS 12	// periods go up in steps of 50ms
+
+#define CHANNEL_WIDTH 32
+#define LOG_MIN_LENGTH 3
+#define LOG_MAX_LENGTH 6
+#define LOG_MIN_GAP 1
+#define LOG_MAX_GAP 4
+#define CHANNEL_MIN_PERIOD 850
+#define CHANNEL_PERIOD_STEPS 10
+
+// From FAST_VEHICLE_LEVEL, each lane has an even chance of a fast vehicle,
+// which moves 2 (or, from FAST_VEHICLE_LEVEL + 6, up to 3) times as fast
+// as the rest of the lane
+#define FAST_VEHICLE_LEVEL 6
+#define FAST_VEHICLE_MAX_LENGTH 2
+
+// Holes are kept at least one column apart. Each hole rules out at most
+// three columns, so a narrow board may only have room for a third of its
+// columns to be holes.
+#define MIN_HOLES 2
+#define MAX_HOLES (BOARD_NUM_COLUMNS >= 15 ? 5 : (BOARD_NUM_COLUMNS + 2) / 3)
+
+static const PixelColour vehicle_colours[] PROGMEM = {
+	COLOUR_RED, COLOUR_YELLOW, COLOUR_LIGHT_YELLOW, COLOUR_ORANGE,
+	COLOUR_LIGHT_ORANGE
+};
+static const PixelColour log_colours[] PROGMEM = {
+	COLOUR_ORANGE, COLOUR_RED, COLOUR_YELLOW
+};
+
+static uint32_t random_state;
+
+static void seed_random(uint32_t seed) {
+	// Mix the bits (MurmurHash3 finaliser) so that similar seeds give
+	// unrelated sequences
+	seed ^= seed >> 16;
+	seed *= 0x85EBCA6BUL;
+	seed ^= seed >> 13;
+	seed *= 0xC2B2AE35UL;
+	seed ^= seed >> 16;
+	random_state = seed ? seed : 1;
+}
+
+static uint32_t next_random(void) {
+	// xorshift32
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+// Return a random number from min to max (inclusive)
+static uint8_t random_between(uint8_t min, uint8_t max) {
+	return min + next_random() % (uint8_t)(max - min + 1);
+}
+
+// Fill in a row pattern with runs of 1 bits (vehicles or logs) separated
+// by gaps. The gap where the pattern wraps around is at least min_gap.
+static void generate_row(LevelRow* row, uint8_t width,
+		uint8_t min_length, uint8_t max_length,
+		uint8_t min_gap, uint8_t max_gap) {
+	// Set the bits a byte at a time - 64 bit shifts are expensive on the
+	// AVR (see pattern_bit() in levels.c)
+	uint8_t* pattern = (uint8_t*)&row->pattern;
+	uint8_t bit = 0;
+	uint8_t length;
+
+	row->pattern = 0;
+	row->fast_length = 0;
+	row->fast_start = 0;
+	row->fast_speed = 0;
+	row->fast_colour = COLOUR_BLACK;
+	row->width = width;
+	row->direction = (next_random() & 1) ? 1 : -1;
+	for(;;) {
+		length = random_between(min_length, max_length);
+		if(bit + length + min_gap > width) {
+			break;
+		}
+		for(; length > 0; length--, bit++) {
+			pattern[bit >> 3] |= 1 << (bit & 7);
+		}
+		bit += random_between(min_gap, max_gap);
+	}
+}
+
+void generate_level_layout(uint8_t level, uint32_t seed, uint8_t attempt,
+		LevelDescriptor* descriptor) {
+	uint8_t holes;
+	RowMask hole;
+
+	seed_random(seed + level * 0x9E3779B9UL + attempt * 0x632BE5ABUL);
+
+	for(uint8_t i = 0; i < FIRST_CHANNEL_INDEX; i++) {
+		LevelRow* lane = &descriptor->rows[i];
+		generate_row(lane, LANE_WIDTH, VEHICLE_MIN_LENGTH, VEHICLE_MAX_LENGTH,
+				VEHICLE_MIN_GAP, VEHICLE_MAX_GAP);
+		lane->period = LANE_MIN_PERIOD + 50 * random_between(0, LANE_PERIOD_STEPS);
+		lane->colour = pgm_read_byte(&vehicle_colours[
+				random_between(0, sizeof(vehicle_colours) - 1)]);
+	}
+	for(uint8_t i = FIRST_CHANNEL_INDEX; i < NUM_MOVING_ROWS; i++) {
+		LevelRow* channel = &descriptor->rows[i];
+		generate_row(channel, CHANNEL_WIDTH, LOG_MIN_LENGTH, LOG_MAX_LENGTH,
+				LOG_MIN_GAP, LOG_MAX_GAP);
+		channel->period = CHANNEL_MIN_PERIOD + 50 * random_between(0, CHANNEL_PERIOD_STEPS);
+		channel->colour = pgm_read_byte(&log_colours[
+				random_between(0, sizeof(log_colours) - 1)]);
+	}
+
+	// Open up the holes in the riverbank, keeping bank between them
+	descriptor->riverbank = ROW_MASK_ALL;
+	holes = random_between(MIN_HOLES, MAX_HOLES);
+	while(holes > 0) {
+		hole = COLUMN_BIT(random_between(0, LAST_COLUMN));
+		if((~descriptor->riverbank & ROW_MASK_ALL & (RowMask)(hole | hole << 1 | hole >> 1)) == 0) {
+			descriptor->riverbank &= ~hole;
+			holes--;
+		}
+	}
+
+	// The fast vehicles are chosen last, so that the rest of the layout is
+	// the same as on the earlier levels
+	for(uint8_t i = 0; i < FIRST_CHANNEL_INDEX && level >= FAST_VEHICLE_LEVEL; i++) {
+		LevelRow* lane = &descriptor->rows[i];
+		if(next_random() & 1) {
+			uint8_t colour = random_between(0, sizeof(vehicle_colours) - 2);
+			lane->fast_start = random_between(0, lane->width - 1);
+			lane->fast_length = random_between(1, FAST_VEHICLE_MAX_LENGTH);
+			lane->fast_speed = random_between(2, level >= FAST_VEHICLE_LEVEL + 6 ? 3 : 2);
+			// A different colour from the rest of the lane
+			if(pgm_read_byte(&vehicle_colours[colour]) == lane->colour) {
+				colour = sizeof(vehicle_colours) - 1;
+			}
+			lane->fast_colour = pgm_read_byte(&vehicle_colours[colour]);
+		}
+	}
+}
+
+uint8_t generate_level_descriptor(uint8_t level, uint32_t seed,
+		LevelDescriptor* descriptor) {
+	for(uint8_t attempt = 1; attempt <= LEVELGEN_MAX_ATTEMPTS; attempt++) {
+		generate_level_layout(level, seed, attempt, descriptor);
+		// The level must also fit in the entity pool
+		if(entities_needed(descriptor) <= LEVEL_MAX_ENTITIES &&
+				is_level_solvable(descriptor, level)) {
+			return attempt;
+		}
+	}
+	return 0;
+}
+
+RowMask level_reachable_holes(const LevelDescriptor* descriptor, uint8_t level) {
+	SolverState state;
+	solver_start_of_level(descriptor, level, &state);
+	return solver_search(descriptor, &state, LEVELGEN_TIME_LIMIT / SOLVER_STEP_TIME);
+}
+
+uint8_t is_level_solvable(const LevelDescriptor* descriptor, uint8_t level) {
+	RowMask holes = ~descriptor->riverbank & ROW_MASK_ALL;
+	return level_reachable_holes(descriptor, level) == holes;
+}
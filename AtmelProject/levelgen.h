@@ -0,0 +1,48 @@
+/*
+ * levelgen.h
+ *
+ * Level generator. The levels after the built-in ones (see levels.h) are
+ * generated from a seed, so every game with a different seed gets new
+ * traffic and river layouts. The same seed and level always give the
+ * same layout (so replays work).
+ *
+ * Each generated level is checked to make sure it can be solved before it
+ * is used. The solver (see solver.h) follows the set of positions the
+ * frog could be in through time from the start of the level. The level is
+ * solvable if every hole in the riverbank can be reached within the time
+ * limit for a frog.
+ */
+
+#ifndef LEVELGEN_H_
+#define LEVELGEN_H_
+
+#include <stdint.h>
+#include "levels.h"
+
+// Time (ms) a frog has to get to the riverbank (the time limit in
+// project.c)
+#define LEVELGEN_TIME_LIMIT 18000
+
+// Number of layouts we try for a level before giving up
+#define LEVELGEN_MAX_ATTEMPTS 16
+
+// Generate a solvable descriptor for the given level from the seed.
+// Returns the number of layouts tried (1 to LEVELGEN_MAX_ATTEMPTS), or 0
+// if none of them could be solved (the descriptor is then not valid).
+uint8_t generate_level_descriptor(uint8_t level, uint32_t seed,
+		LevelDescriptor* descriptor);
+
+// Generate one layout for the given level from the seed and attempt
+// number, without checking it
+void generate_level_layout(uint8_t level, uint32_t seed, uint8_t attempt,
+		LevelDescriptor* descriptor);
+
+// Return the holes in the riverbank (1 bits, column 0 is the least
+// significant bit) that a frog starting at the start of the level can
+// reach within the time limit
+RowMask level_reachable_holes(const LevelDescriptor* descriptor, uint8_t level);
+
+// Return 1 if every hole in the riverbank can be reached
+uint8_t is_level_solvable(const LevelDescriptor* descriptor, uint8_t level);
+
+#endif /* LEVELGEN_H_ */
@@ -0,0 +1,206 @@
+/*
+ * levels.c
+ *
+ * Level descriptors - see levels.h
+ */
+
+#include <stdint.h>
+
+#include "hal.h"
+#include "levelgen.h"
+#include "levels.h"
+
+#if NUM_LANES == 3 && NUM_CHANNELS == 2 && BOARD_NUM_COLUMNS == 16
+#define HAVE_BUILTIN_LEVELS
+
+// Lanes 1 and 3 move to the right; lane 2 moves to the left. River row 5
+// moves to the left; row 6 moves to the right.
+static const LevelDescriptor level_descriptors[] PROGMEM = {
+	// Level pattern A
+	{
+		{
+			{ 0b1100001100011000110000011001100011000011000110001100000110011000, 64, 1, 1000, COLOUR_RED },
+			{ 0b0011100000111000011100000111000011100001110001110000111000011100, 64, -1, 1150, COLOUR_YELLOW },
+			{ 0b0000111100001111000011110000111100001111000001111100001111000111, 64, 1, 750, COLOUR_RED },
+			{ 0b11110001100111000111100011111000, 32, -1, 1300, COLOUR_ORANGE },
+			{ 0b11100110111101100001110110011100, 32, 1, 900, COLOUR_ORANGE }
+		},
+		0b1101110111011101
+	},
+	// Level pattern B
+	{
+		{
+			{ 0b0001000110000011001100010000011000100000010000011000110000100010, 64, 1, 1000, COLOUR_LIGHT_YELLOW },
+			{ 0b1110000001110000001110000001110000001110000001110000001110000001, 64, -1, 1150, COLOUR_ORANGE },
+			{ 0b0011110001110001111000110000111000011110000110000111001111000011, 64, 1, 750, COLOUR_LIGHT_YELLOW },
+			{ 0b00111000011110011100011000011110, 32, -1, 1300, COLOUR_RED },
+			{ 0b11100011011100001110001100111100, 32, 1, 900, COLOUR_RED }
+		},
+		0b1011101101111011
+	},
+	// Level pattern C
+	{
+		{
+			{ 0b1111100011111000001111100001111100000011111000111110001111100000, 64, 1, 1000, COLOUR_LIGHT_ORANGE },
+			{ 0b0001110001110001110001110001110001110001110001110001110001110000, 64, -1, 1150, COLOUR_RED },
+			{ 0b0011000001100011000011001100001100011000001100011001100110000110, 64, 1, 750, COLOUR_LIGHT_ORANGE },
+			{ 0b00111001111000001110000110000111, 32, -1, 1300, COLOUR_YELLOW },
+			{ 0b11000011110000111000000011100011, 32, 1, 900, COLOUR_YELLOW }
+		},
+		0b1010111111110101
+	}
+};
+
+#define NUM_LEVEL_DESCRIPTORS (sizeof(level_descriptors) / sizeof(level_descriptors[0]))
+#else
+#define NUM_LEVEL_DESCRIPTORS 0
+#endif
+
+uint8_t get_num_level_descriptors(void) {
+	return NUM_LEVEL_DESCRIPTORS;
+}
+
+void load_builtin_level_descriptor(uint8_t level, LevelDescriptor* descriptor) {
+#ifdef HAVE_BUILTIN_LEVELS
+	memcpy_P(descriptor, &level_descriptors[(level - 1) % NUM_LEVEL_DESCRIPTORS], 
+			sizeof(LevelDescriptor));
+#else
+	// No built-in levels for this board - use a generated layout, 
+	// unchecked
+	generate_level_layout(level, 0, 0, descriptor);
+#endif
+}
+
+void load_level_descriptor(uint8_t level, uint32_t seed, LevelDescriptor* descriptor) {
+	if(level <= NUM_LEVEL_DESCRIPTORS || 
+			!generate_level_descriptor(level, seed, descriptor)) {
+		// Built-in level, or we couldn't generate a solvable one
+		load_builtin_level_descriptor(level, descriptor);
+	}
+}
+
+RowVelocity level_row_velocity(const LevelRow* row, uint8_t level) {
+	// The speed multiplier is level/4 + 3/4, i.e. (level+3)/4, so the row
+	// moves (level+3) / (4 * period) columns per ms - (level+3) * 2^30 / 
+	// period as a 32 bit fraction. We divide 2^30 first and then the 
+	// remainder so that everything fits in 32 bits. We round up, so that 
+	// a row with a whole number period scrolls exactly every period.
+	uint32_t quotient = (1UL << 30) / row->period;
+	uint32_t remainder = (1UL << 30) % row->period;
+	return quotient * (level + 3) + 
+			(remainder * (level + 3) + row->period - 1) / row->period;
+}
+
+uint16_t level_row_advance(uint32_t* phase, RowVelocity velocity, uint16_t time) {
+	// velocity * time has up to 48 bits. We multiply the two halves of
+	// the velocity separately - the low 32 bits of the product are added
+	// to the phase and the high 16 bits are whole columns.
+	uint32_t high = (velocity >> 16) * time;
+	uint32_t low = (velocity & 0xFFFF) * time;
+	uint32_t fraction = (high << 16) + low;
+	uint16_t columns = (high + (low >> 16)) >> 16;
+	*phase += fraction;
+	if(*phase < fraction) {
+		// Carried into a whole column
+		columns++;
+	}
+	return columns;
+}
+
+// Return the given bit of a row pattern. We index the bytes of the
+// pattern directly (the AVR is little endian) rather than doing a 64 bit
+// shift, which is very expensive on the AVR.
+static uint8_t pattern_bit(const LevelRow* row, uint8_t bit_position) {
+	return (((const uint8_t*)&row->pattern)[bit_position >> 3] >> (bit_position & 7)) & 1;
+}
+
+RowMask level_row_mask(const LevelRow* row, uint8_t position, uint8_t invert) {
+	RowMask mask = 0;
+	for(uint8_t i=0; i<=LAST_COLUMN; i++) {
+		if(pattern_bit(row, position) ^ invert) {
+			mask |= COLUMN_BIT(i);
+		}
+		position++;
+		if(position >= row->width) {
+			position = 0;
+		}
+	}
+	return mask;
+}
+
+RowMask level_row_shift_mask(RowMask mask, const LevelRow* row, 
+		uint8_t position, int8_t direction, uint8_t invert) {
+	uint8_t bit_position;
+	if(direction == 1) {
+		// New bit appears in column 0
+		return (RowMask)(mask << 1) | (pattern_bit(row, position) ^ invert);
+	} else if(direction == -1) {
+		// New bit appears in the last column
+		bit_position = position + LAST_COLUMN;
+		while(bit_position >= row->width) {
+			bit_position -= row->width;
+		}
+		return (mask >> 1) | 
+				((RowMask)(pattern_bit(row, bit_position) ^ invert) << LAST_COLUMN);
+	}
+	return mask;
+}
+
+uint8_t level_phase_columns(uint32_t phase, uint8_t speed) {
+	uint8_t columns = 0;
+	uint32_t fraction = 0;
+	for(uint8_t i = 0; i < speed; i++) {
+		fraction += phase;
+		if(fraction < phase) {
+			// Carried into a whole column
+			columns++;
+		}
+	}
+	return columns;
+}
+
+uint8_t level_row_position_at_speed(const LevelRow* row, uint8_t position,
+		uint32_t phase, uint8_t speed) {
+	// After the row has scrolled n times (and moved phase on towards the
+	// next scroll) the position is -direction * n, modulo the width. 
+	// Something moving speed times as fast has moved speed * (n + phase)
+	// columns - speed * n plus the whole columns of speed * phase.
+	uint16_t result = (uint16_t)position * speed + 
+			(uint16_t)level_phase_columns(phase, speed) * (row->width - row->direction);
+	return result % row->width;
+}
+
+// Return a mask with the given number of columns set from column 0
+static RowMask first_columns(int16_t columns) {
+	if(columns >= BOARD_NUM_COLUMNS) {
+		return ROW_MASK_ALL;
+	}
+	return COLUMN_BIT(columns) - 1;
+}
+
+RowMask level_span_mask(uint8_t column, uint8_t length, uint8_t width) {
+	RowMask mask = 0;
+	// The run is repeated every width columns across the display. It 
+	// starts with the part which wrapped around from the end of the loop.
+	for(int16_t x = (int16_t)column - width; x < BOARD_NUM_COLUMNS; x += width) {
+		if(x < 0) {
+			if(x + length > 0) {
+				mask |= first_columns(x + length);
+			}
+		} else {
+			mask |= (RowMask)(first_columns(length) << x);
+		}
+	}
+	return mask;
+}
+
+uint8_t level_row_fast_column(const LevelRow* row, uint8_t position, uint32_t phase) {
+	position = level_row_position_at_speed(row, position, phase, row->fast_speed);
+	// The vehicle starts at pattern bit fast_start, which is shown 
+	// position columns to the left of it
+	uint8_t column = row->fast_start + row->width - position;
+	if(column >= row->width) {
+		column -= row->width;
+	}
+	return column;
+}
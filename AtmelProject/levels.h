@@ -0,0 +1,103 @@
+/*
+ * levels.h
+ *
+ * Level descriptors. Each level is described by the patterns, speeds and
+ * colours of its moving rows and the holes in its riverbank. The built-in
+ * descriptors are kept in program memory - only the current level is
+ * copied into RAM (by the game module). Levels after the built-in ones
+ * are generated from a seed (see levelgen.h).
+ */
+
+#ifndef LEVELS_H_
+#define LEVELS_H_
+
+#include <stdint.h>
+#include "game.h"
+#include "pixel_colour.h"
+#include "playfield.h"
+
+// A lane of traffic or a river channel. The pattern is looped 
+// continuously - a 1 bit is a vehicle (or log), 0 is empty road (or 
+// water). Bit 0 is shown in column 0 (the left hand side) when the row
+// is at position 0 (see game.c).
+// A lane may also have a fast vehicle, which moves fast_speed times as
+// fast as the pattern and overtakes it (see entities.h). It starts at 
+// pattern bit fast_start. fast_length is 0 if there is none.
+typedef struct {
+	uint64_t pattern;
+	uint8_t width;			// number of pattern bits used (at most 64)
+	int8_t direction;		// 1 for right, -1 for left
+	uint16_t period;		// ms between scrolls on level 1 (rows speed up 
+							// on later levels)
+	PixelColour colour;
+	uint8_t fast_start;
+	uint8_t fast_length;
+	uint8_t fast_speed;
+	PixelColour fast_colour;
+} LevelRow;
+
+typedef struct LevelDescriptor {
+	// The moving rows in the order used by the game module - the traffic 
+	// lanes (display rows 1 to 3 by default), then the river channels 
+	// (display rows 5 and 6) - see playfield.h
+	LevelRow rows[NUM_MOVING_ROWS];
+	// Riverbank pattern - a 1 is the bank, 0 is a hole. The least 
+	// significant bit corresponds to column 0 on the display.
+	RowMask riverbank;
+} LevelDescriptor;
+
+// Number of built-in level descriptors. The levels after these are
+// generated. (The built-in levels are for the default board - other
+// boards only have generated levels.)
+uint8_t get_num_level_descriptors(void);
+
+// Copy the built-in descriptor for the given level (1 upwards) from
+// program memory. After the last one they start again from the first.
+void load_builtin_level_descriptor(uint8_t level, LevelDescriptor* descriptor);
+
+// Get the descriptor for the given level (1 upwards). The built-in levels
+// come first, then levels generated from the given seed.
+void load_level_descriptor(uint8_t level, uint32_t seed, LevelDescriptor* descriptor);
+
+// Return the speed of the given row on the given level (see game.h). Rows
+// speed up on later levels.
+RowVelocity level_row_velocity(const LevelRow* row, uint8_t level);
+
+// Move a row on by the given time (ms) at the given speed. phase is the
+// part of a column (32 bit fraction) the row has moved since it last
+// scrolled, and is updated. Returns the number of whole columns the row
+// scrolls.
+uint16_t level_row_advance(uint32_t* phase, RowVelocity velocity, uint16_t time);
+
+// Return the mask for the columns of a row showing its pattern at the
+// given position (the bit position of the pattern shown in column 0). If
+// invert is 1 then the mask bits are set where the pattern bits are clear.
+RowMask level_row_mask(const LevelRow* row, uint8_t position, uint8_t invert);
+
+// Return the whole number of columns in speed * phase (a 32 bit fraction
+// of a column)
+uint8_t level_phase_columns(uint32_t phase, uint8_t speed);
+
+// Return the position (as for the row) of something moving speed times as
+// fast as the row, with the row at the given position and phase. Both 
+// started together at position 0.
+uint8_t level_row_position_at_speed(const LevelRow* row, uint8_t position,
+		uint32_t phase, uint8_t speed);
+
+// Return the columns covered by a run of length columns starting at the
+// given column of the loop of width columns (0 to width-1 - the columns 
+// from BOARD_NUM_COLUMNS are off the display). The run wraps around the
+// loop.
+RowMask level_span_mask(uint8_t column, uint8_t length, uint8_t width);
+
+// Return the column (as for level_span_mask()) of the left hand end of the
+// fast vehicle of a row, with the row at the given position and phase
+uint8_t level_row_fast_column(const LevelRow* row, uint8_t position, uint32_t phase);
+
+// Return the row mask after the pattern has scrolled one column in the 
+// given direction (-1 for left, 1 for right) to its new position. Only 
+// the bit scrolling on to the display needs to be read from the pattern.
+RowMask level_row_shift_mask(RowMask mask, const LevelRow* row, 
+		uint8_t position, int8_t direction, uint8_t invert);
+
+#endif /* LEVELS_H_ */
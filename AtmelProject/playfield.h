@@ -0,0 +1,73 @@
+/*
+ * playfield.h
+ *
+ * Geometry of the game field - the number of columns and the role of
+ * each row. Everything the game, level and solver modules need to know
+ * about the size of the board comes from here, as compile time constants.
+ * Any of the settings can be overridden on the compiler command line
+ * (e.g. -DBOARD_NUM_COLUMNS=24 -DNUM_LANES=4).
+ *
+ * From the bottom, the rows are: the start row (roadside), NUM_LANES lanes
+ * of traffic, the halfway row (roadside), NUM_CHANNELS river channels,
+ * then the riverbank.
+ *
+ * By default the board is as wide as the LED matrix (see ledmatrix.h) -
+ * e.g. -DLEDMATRIX_PANELS_X=2 gives a 32 column board on two panels. A
+ * board wider than the LED matrix builds, but only the part which fits
+ * is shown.
+ */
+
+#ifndef PLAYFIELD_H_
+#define PLAYFIELD_H_
+
+#include <stdint.h>
+#include "ledmatrix.h"
+
+#ifndef BOARD_NUM_COLUMNS
+#define BOARD_NUM_COLUMNS MATRIX_NUM_COLUMNS
+#endif
+#ifndef NUM_LANES
+#define NUM_LANES 3
+#endif
+#ifndef NUM_CHANNELS
+#define NUM_CHANNELS 2
+#endif
+
+// Rows
+#define START_ROW 0			// row position where the frog starts
+#define FIRST_VEHICLE_ROW 1
+#define HALFWAY_ROW (FIRST_VEHICLE_ROW + NUM_LANES) // row where the frog can rest
+#define FIRST_RIVER_ROW (HALFWAY_ROW + 1)
+#define RIVERBANK_ROW (FIRST_RIVER_ROW + NUM_CHANNELS) // row where the frog finishes
+#define BOARD_NUM_ROWS (RIVERBANK_ROW + 1)
+
+#define LAST_COLUMN (BOARD_NUM_COLUMNS - 1)
+#define FROG_START_COLUMN ((BOARD_NUM_COLUMNS - 1) / 2)
+
+// The traffic lanes and river channels each scroll at their own speed.
+// These "moving rows" are numbered from 0 - the lanes first, then the
+// channels.
+#define NUM_MOVING_ROWS (NUM_LANES + NUM_CHANNELS)
+#define FIRST_CHANNEL_INDEX NUM_LANES
+
+// Display row of the given moving row
+#define MOVING_ROW(index) ((index) < FIRST_CHANNEL_INDEX ? \
+		FIRST_VEHICLE_ROW + (index) : FIRST_RIVER_ROW + (index) - FIRST_CHANNEL_INDEX)
+
+// A bit mask with one bit for each column of a row (column 0 is the least
+// significant bit) - the smallest type which will do
+#if BOARD_NUM_COLUMNS <= 8
+typedef uint8_t RowMask;
+#elif BOARD_NUM_COLUMNS <= 16
+typedef uint16_t RowMask;
+#elif BOARD_NUM_COLUMNS <= 32
+typedef uint32_t RowMask;
+#else
+#error "BOARD_NUM_COLUMNS must be at most 32"
+#endif
+
+// Mask with a bit set for every column
+#define ROW_MASK_ALL ((RowMask)(((RowMask)~(RowMask)0) >> (8 * sizeof(RowMask) - BOARD_NUM_COLUMNS)))
+#define COLUMN_BIT(column) ((RowMask)1 << (column))
+
+#endif /* PLAYFIELD_H_ */
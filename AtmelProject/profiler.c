@@ -0,0 +1,63 @@
+/*
+ * profiler.c
+ *
+ * Main loop latency profiler - see profiler.h
+ */
+
+#include <stdint.h>
+
+#include "profiler.h"
+#include "timer0.h"
+
+static uint32_t buckets[PROFILER_NUM_BUCKETS];
+static uint32_t iterations;
+static uint32_t worst_duration;
+static uint16_t worst_work;
+
+static uint32_t iteration_start;
+
+void profiler_reset(void) {
+	for(uint8_t i = 0; i < PROFILER_NUM_BUCKETS; i++) {
+		buckets[i] = 0;
+	}
+	iterations = 0;
+	worst_duration = 0;
+	worst_work = 0;
+}
+
+void profiler_begin_iteration(void) {
+	iteration_start = get_current_time_us();
+}
+
+void profiler_end_iteration(uint16_t work) {
+	uint32_t duration = get_current_time_us() - iteration_start;
+	
+	// The bucket is the number of significant bits in the duration
+	uint8_t bucket = 0;
+	for(uint32_t d = duration; d && bucket < PROFILER_NUM_BUCKETS - 1; d >>= 1) {
+		bucket++;
+	}
+	buckets[bucket]++;
+	iterations++;
+	
+	if(duration > worst_duration) {
+		worst_duration = duration;
+		worst_work = work;
+	}
+}
+
+uint32_t profiler_get_iterations(void) {
+	return iterations;
+}
+
+uint32_t profiler_get_bucket(uint8_t bucket) {
+	return buckets[bucket];
+}
+
+uint32_t profiler_get_worst_duration(void) {
+	return worst_duration;
+}
+
+uint16_t profiler_get_worst_work(void) {
+	return worst_work;
+}
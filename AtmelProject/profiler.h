@@ -0,0 +1,38 @@
+/*
+ * profiler.h
+ *
+ * Main loop latency profiler.
+ *
+ * Each iteration of the main loop is timed with the microsecond clock
+ * (8us resolution - see get_current_time_us()). The durations are counted
+ * in a histogram with log2 sized buckets: bucket 0 holds iterations
+ * shorter than 1us, and bucket n (n >= 1) holds iterations of 2^(n-1)
+ * to 2^n - 1 us. The last bucket also holds anything longer.
+ *
+ * The longest iteration is remembered along with a description of the
+ * work it did - the scheduled tasks that ran (see scheduler_get_tasks_run()).
+ */
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <stdint.h>
+
+#define PROFILER_NUM_BUCKETS 18
+
+// Clear the histogram and the longest iteration
+void profiler_reset(void);
+
+// Call at the start and end of the part of each loop iteration to be
+// timed. work describes what the iteration did (e.g. a bit mask of the
+// tasks run).
+void profiler_begin_iteration(void);
+void profiler_end_iteration(uint16_t work);
+
+// Results. Durations are in microseconds.
+uint32_t profiler_get_iterations(void);
+uint32_t profiler_get_bucket(uint8_t bucket);
+uint32_t profiler_get_worst_duration(void);
+uint16_t profiler_get_worst_work(void);
+
+#endif /* PROFILER_H_ */
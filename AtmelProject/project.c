@@ -6,39 +6,118 @@
  * Author: Peter Sutton. Modified by <YOUR NAME HERE>
  */ 
 
-#include <avr/io.h>
-#include <avr/interrupt.h>
-#include <avr/pgmspace.h>
 #include <stdio.h>
 
+#include "hal.h"
+#include "animation.h"
 #include "ledmatrix.h"
 #include "scrolling_char_display.h"
 #include "buttons.h"
 #include "highscores.h"
+#include "input.h"
 #include "joystick.h"
+#include "profiler.h"
 #include "serialio.h"
 #include "terminalio.h"
+#include "scheduler.h"
 #include "score.h"
 #include "sevenseg.h"
+#include "solver.h"
 #include "sound_effects.h"
 #include "timer0.h"
 #include "game.h"
 
-#define F_CPU 8000000L
-#include <util/delay.h>
-
 // Function prototypes - these are defined below (after main()) in the order
 // given here
 void initialise_hardware(void);
 void splash_screen(void);
+static void scroll_until_input(void);
+static void scroll_input_task(uint8_t arg);
+static uint16_t get_level_value(void);
 void new_game(void);
 void play_game(void);
+static void game_status_task(uint8_t arg);
+static void start_next_level(uint8_t arg);
+static void lose_life(uint8_t arg);
+static uint8_t frog_can_move(void);
+static void input_task(uint8_t arg);
+static void joystick_task(uint8_t arg);
+static void motion_task(uint8_t arg);
+static void autopilot_task(uint8_t arg);
+static void show_autopilot(void);
+static void sevenseg_task(uint8_t arg);
+static void sound_task(uint8_t arg);
+static void print_task_stats(void);
+static void print_display_stats(void);
+static void print_loop_profile(void);
+static void load_replay_log(void);
 void handle_game_over(void);
 static void draw_splash_frog();
 
 // ASCII code for Escape character
 #define ESCAPE_CHAR 27
 
+// Time limit for each frog in ms
+#define TIME_LIMIT 18000
+// Time between simulated button presses when holding down a button
+#define BUTTON_HOLD_DELAY 200
+// Time between simulated movements when holding the joystick in a direction
+#define JOYSTICK_HOLD_DELAY 400
+#define JOYSTICK_CHANGE_DIR_DELAY 200
+
+// How often (ms) each of the play_game() tasks runs. The motion task moves
+// the vehicles and logs on every ms - each row scrolls when it has moved
+// a whole column at its own speed.
+#define GAME_STATUS_TASK_PERIOD 5
+#define INPUT_TASK_PERIOD 5
+#define JOYSTICK_TASK_PERIOD 20
+#define SEVENSEG_TASK_PERIOD 5
+#define SOUND_TASK_PERIOD 10
+#define MOTION_TASK_PERIOD 1
+// Most time (ms) the motion task catches up on if it runs late
+#define MOTION_MAX_CATCH_UP 20
+#define AUTOPILOT_TASK_PERIOD SOLVER_STEP_TIME
+// How often (ms) we check for input while messages are scrolling
+#define SCROLL_INPUT_TASK_PERIOD 5
+
+// Rate (pixels per second) of the messages scrolled on the LED matrix
+#define SCROLL_RATE 7
+
+// Animations (see animation.h). The level transition wipes the display to
+// the left. A frog which dies flashes for a second - the last frog 
+// flashes and then the display fades out.
+static const AnimationKeyframe level_transition_animation[] PROGMEM = {
+	{ ANIMATION_SHIFT_LEFT, MATRIX_NUM_COLUMNS, 7, 0 },
+	{ ANIMATION_END, 0, 0, 0 }
+};
+static const AnimationKeyframe death_animation[] PROGMEM = {
+	{ ANIMATION_FLASH, 10, 10, PALETTE_DEAD_FROG },
+	{ ANIMATION_END, 0, 0, 0 }
+};
+static const AnimationKeyframe game_over_animation[] PROGMEM = {
+	{ ANIMATION_FLASH, 6, 10, PALETTE_DEAD_FROG },
+	{ ANIMATION_FADE_OUT, 8, 5, 0 },
+	{ ANIMATION_CLEAR, 1, 0, 0 },
+	{ ANIMATION_END, 0, 0, 0 }
+};
+
+// State of the game being played, shared between the play_game() tasks
+// Time at which the current frog began its life
+static uint32_t begin_life_time;
+static uint8_t is_paused;
+static uint32_t time_pause_began;
+static uint32_t last_button_pushed_at; // time in ms
+static uint32_t joystick_last_moved; // time in ms
+static uint8_t joystick_last_direction;
+// Whether the frog is being moved by the autopilot (see autopilot_task())
+static uint8_t autopilot_on;
+// Time up to which the vehicles and logs have been moved
+static uint32_t motion_time;
+// Whether there has been input while messages are scrolling, and where
+// the joystick was when last checked
+static uint8_t scroll_cancelled;
+static uint8_t scroll_joystick_direction;
+
 /////////////////////////////// main //////////////////////////////////
 int main(void) {
 	// Setup hardware and call backs. This will turn on 
@@ -66,8 +145,7 @@ void initialise_hardware(void) {
 	init_timer0();
 	
 	// Initialise the LEDs used for displaying the number of lives remaining
-	// LEDs are on the upper 4 bits of Port A
-	DDRA |= 0xF0;
+	hal_init_lives_leds();
 	
 	// Initialise the Seven Segment Display for showing the time left this life
 	init_sevenseg();
@@ -79,7 +157,7 @@ void initialise_hardware(void) {
 	init_joystick();
 	
 	// Turn on global interrupts
-	sei();
+	hal_enable_interrupts();
 }
 
 void splash_screen(void) {
@@ -95,20 +173,66 @@ void splash_screen(void) {
 	draw_splash_frog();
 	draw_high_scores(33, 6);
 	
-	// Output the scrolling message to the LED matrix
-	// and wait for a push button to be pushed.
+	// Scroll the messages on the LED matrix until there is any input
 	ledmatrix_clear();
-	while(1) {
-		set_scrolling_display_text("FROGGER    S4480118", COLOUR_GREEN);
-		// Scroll the message until it has scrolled off the 
-		// display or a button is pushed
-		while(scroll_display()) {
-			_delay_ms(150);
-			if(button_pushed() != NO_BUTTON_PUSHED) {
-				return;
-			}
+	scroller_clear_messages();
+	scroller_queue_message(PSTR("FROGGER    S4480118"), COLOUR_GREEN, 0);
+	scroller_queue_message(PSTR("HIGH SCORE #"), COLOUR_YELLOW, get_top_high_score);
+	scroll_until_input();
+}
+
+// Scroll the queued messages over and over (see scrolling_char_display.h)
+// until there is a button push, serial input or joystick move. The 
+// sound effects carry on meanwhile. This returns as soon as the input
+// task sees the input, rather than when the message has scrolled off.
+// The messages are rendered once, unless they are too long for the 
+// scroller's bitmap - then they are scrolled straight from the text.
+static void scroll_until_input(void) {
+	init_scheduler();
+	if (!scroller_render() || 
+			!scroller_start_rendered(SCROLL_RATE * SCROLLER_SUBPIXELS, 1)) {
+		scroller_start(SCROLL_RATE, 1);
+	}
+	scheduler_add_periodic(PSTR("input"), scroll_input_task, 0, 
+			SCROLL_INPUT_TASK_PERIOD, 0);
+	scheduler_add_periodic(PSTR("sound"), sound_task, 0, SOUND_TASK_PERIOD, 0);
+	
+	scroll_cancelled = 0;
+	scroll_joystick_direction = poll_joystick_direction();
+	while(!scroll_cancelled) {
+		scheduler_run_due();
+		scheduler_idle();
+	}
+	scroller_stop();
+}
+
+// Check for input while messages are scrolling. Input logs to be replayed
+// can be sent over the serial port (as the "#REPLAY" lines written while
+// recording) - these are loaded rather than counting as input, as are
+// line endings. The joystick counts as input when it is moved, not if it
+// is held where it was (e.g. at the end of a game).
+static void scroll_input_task(uint8_t arg) {
+	uint8_t direction = poll_joystick_direction();
+	
+	if(button_pushed() != NO_BUTTON_PUSHED) {
+		scroll_cancelled = 1;
+	} else if(serial_input_available()) {
+		int c = fgetc(stdin);
+		if(c == '#') {
+			load_replay_log();
+		} else if(c != '\r' && c != '\n') {
+			scroll_cancelled = 1;
 		}
+	} else if(direction && direction != scroll_joystick_direction) {
+		// (Direction 0 is the joystick at rest)
+		scroll_cancelled = 1;
 	}
+	scroll_joystick_direction = direction;
+}
+
+// Level as a value for a scrolling message
+static uint16_t get_level_value(void) {
+	return get_level();
 }
 
 void new_game(void) {
@@ -121,7 +245,10 @@ void new_game(void) {
 	// Set number of lives to maximum value
 	init_lives();
 	
-	// Set the level to initial value
+	// Set the level to initial value. The levels after the built-in ones
+	// are generated from a seed - the time taken to start the game is as
+	// good as random.
+	set_level_seed(get_current_time());
 	init_level();
 	
 	// Initialise the game and display
@@ -134,310 +261,521 @@ void new_game(void) {
 }
 
 void play_game(void) {
-	uint32_t current_time = get_current_time();
-	// Time limit for each frog in ms
-	uint32_t time_limit = 18000;
-	// Time at which the current frog began its life
-	uint32_t begin_life_time = current_time;
-	uint32_t last_move_times[5]; // 5 unique scrolling speeds
-	// Each speed has a time between scrolls in milliseconds
-	uint32_t scroll_times[5] = {1000, 1150, 750, 1300, 900};
-	int8_t button;
-	uint32_t last_button_pushed_at = 0; // time in ms
-	// Time between simulated button presses when holding down a button
-	uint16_t button_hold_delay = 200;
-	char serial_input, escape_sequence_char;
-	uint8_t characters_into_escape_sequence = 0;
-	uint8_t is_paused = 0;
-	uint32_t time_pause_began = 0;
-	uint32_t joystick_last_moved = 0; // time in ms
-	uint8_t joystick_last_direction = -1;
-	// Time between simulated movements when holding the joystick in a direction
-	uint16_t joystick_hold_delay = 400;
-	uint16_t joystick_change_dir_delay = 200;
-	
-	// Remember the current time as the last time the vehicles and logs were moved.
-	for (int i = 0; i < 5; i++) {
-		last_move_times[i] = current_time;
+	// Replay the input from a log if one has been loaded, otherwise record
+	// the input so that this game can be replayed. The level seed is
+	// recorded too so the replay gets the same generated levels.
+	if (input_replay_loaded()) {
+		uint8_t level;
+		uint32_t seed;
+		input_start_replay(&level, &seed);
+		if (level != get_level() || seed != get_level_seed()) {
+			set_level_seed(seed);
+			set_level(level);
+			initialise_game();
+		}
+	} else {
+		input_start_recording(get_level(), get_level_seed());
 	}
 	
+	// Reset the game state shared by the tasks below
+	begin_life_time = get_current_time();
+	is_paused = 0;
+	time_pause_began = 0;
+	last_button_pushed_at = 0;
+	joystick_last_moved = 0;
+	joystick_last_direction = -1;
+	autopilot_on = 0;
+	motion_time = get_current_time();
+	
+	// Each part of the game runs as a task when it is due
+	animation_stop();
+	init_scheduler();
+	scheduler_add_periodic(PSTR("status"), game_status_task, 0, GAME_STATUS_TASK_PERIOD, 0);
+	scheduler_add_periodic(PSTR("input"), input_task, 0, INPUT_TASK_PERIOD, 0);
+	scheduler_add_periodic(PSTR("joystick"), joystick_task, 0, JOYSTICK_TASK_PERIOD, 0);
+	scheduler_add_periodic(PSTR("motion"), motion_task, 0, MOTION_TASK_PERIOD, 
+			MOTION_TASK_PERIOD);
+	scheduler_add_periodic(PSTR("sevenseg"), sevenseg_task, 0, SEVENSEG_TASK_PERIOD, 0);
+	scheduler_add_periodic(PSTR("sound"), sound_task, 0, SOUND_TASK_PERIOD, 0);
+	scheduler_add_periodic(PSTR("autopilot"), autopilot_task, 0, AUTOPILOT_TASK_PERIOD, 0);
+	
 	// We play the game while we have lives left
+	// When no task is due we sleep until the next interrupt. The time
+	// taken to run the due tasks is profiled.
+	profiler_reset();
 	while(get_lives_remaining()) {
-		if(!is_frog_dead() && frog_has_reached_riverbank()) {
-			// Frog reached the other side successfully but the
-			// riverbank isn't full
-			// Play a sound
-			play_sound_reached_riverbank();
-			// Put a new frog at the start
-			put_frog_in_start_position();
-			// Add 10 to score, frog reached other side successfully
-			add_to_score(10);
-			// Reset begin_life_time to current time
-			begin_life_time = get_current_time();
-		}
-		
-		// We have completed a level, progress to the next one
-		if (is_riverbank_full()) {
-			// Play the new level sound
-			play_sound_new_level();
-			// Shift the LED matrix left
-			for (int i = 0; i < MATRIX_NUM_COLUMNS; i++) {
-				ledmatrix_shift_display_left();
-				update_sound_effects(0);
-				_delay_ms(70);
-			}
-			// Increment the level number
-			set_level(get_level() + 1);
-			// Restore a life (function handles checking if greater than max)
-			set_lives(get_lives_remaining() + 1);
-			// Reset the game state
-			initialise_game();
-			// Reset begin_life_time to current time
-			begin_life_time = get_current_time();
+		profiler_begin_iteration();
+		scheduler_run_due();
+		profiler_end_iteration(scheduler_get_tasks_run());
+		scheduler_idle();
+	}
+	// We get here if we have run out of lives
+	// The game is over.
+	input_finish_recording();
+	
+	// Game has been completed successfully, add 10 to score for last frog
+	// reaching the other side.
+	if (is_riverbank_full() && !is_frog_dead()) {
+		add_to_score(10);
+	}
+}
+
+// Check whether the frog has reached the riverbank, completed the level,
+// died or run out of time.
+static void game_status_task(uint8_t arg) {
+	uint32_t current_time = scheduler_get_time();
+	
+	// The game waits while the level transition or a death is shown
+	if (animation_is_playing()) {
+		return;
+	}
+	
+	if(!is_frog_dead() && frog_has_reached_riverbank()) {
+		// Frog reached the other side successfully but the
+		// riverbank isn't full
+		// Play a sound
+		play_sound_reached_riverbank();
+		// Put a new frog at the start
+		put_frog_in_start_position();
+		// Add 10 to score, frog reached other side successfully
+		add_to_score(10);
+		// Reset begin_life_time to current time
+		begin_life_time = get_current_time();
+	}
+	
+	// We have completed a level, progress to the next one
+	if (is_riverbank_full()) {
+		// Play the new level sound
+		play_sound_new_level();
+		// Wipe the LED matrix to the left - the next level starts when
+		// it has finished (see start_next_level())
+		animation_play(level_transition_animation, start_next_level, 0);
+		return;
+	}
+	
+	// Is the frog dead or the time limit has been reached while unpaused
+	if (is_frog_dead() || (current_time > begin_life_time + TIME_LIMIT && !is_paused)) {
+		kill_frog();
+		// Show the death - the life is taken when it has finished (see
+		// lose_life())
+		if (get_lives_remaining() > 1) {
+			play_sound_death();
+			animation_play(death_animation, lose_life, 0);
+		} else {
+			animation_play(game_over_animation, lose_life, 0);
 		}
+	}
+}
+
+// Start the next level, once the level transition has been shown
+static void start_next_level(uint8_t arg) {
+	// Increment the level number (the vehicles and logs move faster
+	// on the new level)
+	set_level(get_level() + 1);
+	// Restore a life (function handles checking if greater than max)
+	set_lives(get_lives_remaining() + 1);
+	// Reset the game state
+	initialise_game();
+	// Reset begin_life_time to current time
+	begin_life_time = get_current_time();
+}
+
+// Take a life, once the death of the frog has been shown. If the player
+// can continue playing, a new frog is put at the start.
+static void lose_life(uint8_t arg) {
+	if (get_lives_remaining() > 1) {
+		stop_sound();
 		
-		// Is the frog dead or the time limit has been reached while unpaused
-		if (is_frog_dead() || (get_current_time() > begin_life_time + time_limit && !is_paused)) {
-			// Can the player continue playing?
-			if (get_lives_remaining() > 1) {
-				play_sound_death();
-				for (int i = 0; i < 10; i++) {
-					update_sound_effects(0);
-					_delay_ms(100); // Wait for 1000ms
-				}
-				stop_sound();
-				(void) button_pushed();
-				clear_serial_input_buffer();
-				
-				// Clear both lines
-				move_cursor(10,14);
-				clear_to_end_of_line();
-				move_cursor(10,15);
-				clear_to_end_of_line();
-				
-				// Avoids dead frog lingering on roadside/riverbank
-				redraw_roadside(0);
-				redraw_roadside(4);
-				redraw_riverbank();
-				// Put new frog at start position
-				put_frog_in_start_position();
-				
-				// Reset begin_life_time
-				begin_life_time = get_current_time();
-			}
-			
-			// Decrement the number of lives
-			set_lives(get_lives_remaining() - 1);
-		}
+		// Clear both lines
+		move_cursor(10,14);
+		clear_to_end_of_line();
+		move_cursor(10,15);
+		clear_to_end_of_line();
 		
-		// Check for input - which could be a button push or serial input.
-		// Serial input may be part of an escape sequence, e.g. ESC [ D
-		// is a left cursor key press. At most one of the following three
-		// variables will be set to a value other than -1 if input is available.
-		// (We don't initalise button to -1 since button_pushed() will return -1
-		// if no button pushes are waiting to be returned.)
-		// Button pushes take priority over serial input. If there are both then
-		// we'll retrieve the serial input the next time through this loop
-		serial_input = -1;
-		escape_sequence_char = -1;
-		button = button_pushed();
+		// Put new frog at start position (this removes the dead
+		// frog)
+		put_frog_in_start_position();
 		
-		if(button == NO_BUTTON_PUSHED) {
-			// No push button was pushed, see if there is any serial input
-			if(serial_input_available()) {
-				// Serial data was available - read the data from standard input
-				serial_input = fgetc(stdin);
-				// Check if the character is part of an escape sequence
-				if(characters_into_escape_sequence == 0 && serial_input == ESCAPE_CHAR) {
-					// We've hit the first character in an escape sequence (escape)
-					characters_into_escape_sequence++;
-					serial_input = -1; // Don't further process this character
-				} else if(characters_into_escape_sequence == 1 && serial_input == '[') {
-					// We've hit the second character in an escape sequence
-					characters_into_escape_sequence++;
-					serial_input = -1; // Don't further process this character
-				} else if(characters_into_escape_sequence == 2) {
-					// Third (and last) character in the escape sequence
-					escape_sequence_char = serial_input;
-					serial_input = -1;  // Don't further process this character - we
-										// deal with it as part of the escape sequence
-					characters_into_escape_sequence = 0;
-				} else {
-					// Character was not part of an escape sequence (or we received
-					// an invalid second character in the sequence). We'll process 
-					// the data in the serial_input variable.
-					characters_into_escape_sequence = 0;
-				}
-			}
-		} else {
-			// A button was pushed
-			last_button_pushed_at = get_current_time();
+		// Reset begin_life_time
+		begin_life_time = get_current_time();
+	}
+	
+	// Decrement the number of lives
+	set_lives(get_lives_remaining() - 1);
+}
+
+// The frog can be moved unless the game is paused or an animation is
+// playing
+static uint8_t frog_can_move(void) {
+	return !is_paused && !animation_is_playing();
+}
+
+// Check for input - which could be a button push or serial input - and
+// repeat the move of a push button that is being held down.
+static void input_task(uint8_t arg) {
+	char serial_input, escape_sequence_char;
+	int8_t button;
+	int16_t key;
+	uint32_t current_time = scheduler_get_time();
+	
+	// All input comes through the input module so that it can be recorded
+	// and replayed. Serial input may be part of an escape sequence, e.g. 
+	// ESC [ D is a left cursor key press - the input module decodes these.
+	// At most one of the following three variables will be set to a value 
+	// other than -1 if input is available.
+	// (We don't initalise button to -1 since input_button_pushed() will
+	// return -1 if no button pushes are waiting to be returned.)
+	// Button pushes take priority over serial input. If there are both then
+	// we'll retrieve the serial input the next time this task runs
+	serial_input = -1;
+	escape_sequence_char = -1;
+	button = input_button_pushed();
+	
+	if(button == NO_BUTTON_PUSHED) {
+		// No push button was pushed, see if there is any serial input
+		key = input_key_pressed();
+		if(key != INPUT_NO_KEY && (key & INPUT_ESCAPE_KEY)) {
+			escape_sequence_char = key & 0xFF;
+		} else if(key != INPUT_NO_KEY) {
+			serial_input = key;
 		}
-		
-		// Process the input. 
-		if(button==3 || escape_sequence_char=='D' || serial_input=='L' || serial_input=='l') {
-			// Attempt to move left
-			// Only attempt to move if the game isn't paused
-			if (!is_paused) {
-				move_frog_to_left();
-				play_sound_frog_move();
-			}
-		} else if(button==2 || escape_sequence_char=='A' || serial_input=='U' || serial_input=='u') {
-			// Attempt to move forward
-			if (!is_paused) {
-				move_frog_forward();
-				play_sound_frog_move();
-			}
-		} else if(button==1 || escape_sequence_char=='B' || serial_input=='D' || serial_input=='d') {
-			// Attempt to move down
-			if (!is_paused) {
-				move_frog_backward();
-				play_sound_frog_move();
-			}
-		} else if(button==0 || escape_sequence_char=='C' || serial_input=='R' || serial_input=='r') {
-			// Attempt to move right
-			if (!is_paused) {
-				move_frog_to_right();
-				play_sound_frog_move();
-			}
-		} else if(serial_input == 'p' || serial_input == 'P') {
-			// If we are pausing, store the current time to add to begin_life_time after unpausing
-			if (!is_paused) {
-				time_pause_began = get_current_time();
-			} else {
-				// If we are unpausing, add the time paused to begin_life_time
-				begin_life_time += (get_current_time() - time_pause_began);
-			}
-			// Pause/unpause the game until 'p' or 'P' is
-			// pressed again
-			is_paused = ~is_paused;
-		} 
-		// else - invalid input or we're part way through an escape sequence -
-		// do nothing
-		
-		// Find whether a button is currently being held down
-		int8_t button_held_down;
-		if ((PINB & 0x0F) == 0b00000001) {
-			// B0 is being pushed
-			button_held_down = 0;
-		} else if ((PINB & 0x0F) == 0b00000010) {
-			// B1 is being pushed
-			button_held_down = 1;
-		} else if ((PINB & 0x0F) == 0b00000100) {
-			// B2 is being pushed
-			button_held_down = 2;
-		} else if ((PINB & 0x0F) == 0b00001000) {
-			// B3 is being pushed
-			button_held_down = 3;
+	} else {
+		// A button was pushed
+		last_button_pushed_at = current_time;
+	}
+	
+	// Process the input. 
+	if(button==3 || escape_sequence_char=='D' || serial_input=='L' || serial_input=='l') {
+		// Attempt to move left
+		// Only attempt to move if the game isn't paused
+		if (frog_can_move()) {
+			move_frog_to_left();
+			play_sound_frog_move();
+		}
+	} else if(button==2 || escape_sequence_char=='A' || serial_input=='U' || serial_input=='u') {
+		// Attempt to move forward
+		if (frog_can_move()) {
+			move_frog_forward();
+			play_sound_frog_move();
+		}
+	} else if(button==1 || escape_sequence_char=='B' || serial_input=='D' || serial_input=='d') {
+		// Attempt to move down
+		if (frog_can_move()) {
+			move_frog_backward();
+			play_sound_frog_move();
+		}
+	} else if(button==0 || escape_sequence_char=='C' || serial_input=='R' || serial_input=='r') {
+		// Attempt to move right
+		if (frog_can_move()) {
+			move_frog_to_right();
+			play_sound_frog_move();
+		}
+	} else if(serial_input == 'p' || serial_input == 'P') {
+		// If we are pausing, store the current time to add to begin_life_time after unpausing
+		if (!is_paused) {
+			time_pause_began = current_time;
 		} else {
-			// No button is being pushed
-			button_held_down = -2;
+			// If we are unpausing, add the time paused to begin_life_time
+			begin_life_time += (current_time - time_pause_began);
 		}
-		
-		current_time = get_current_time();
-		if (last_button_pushed_at && button_held_down != -2) {
-			// Avoids registering movement just after game begins
-			if (current_time > last_button_pushed_at + button_hold_delay) {
-				if (button_held_down == 3) {
-					if (!is_paused) {
-						move_frog_to_left();
-						play_sound_frog_move();
-					}
-				} else if (button_held_down == 2) {
-					if (!is_paused) {
-						move_frog_forward();
-						play_sound_frog_move();
-					}
-				} else if (button_held_down == 1) {
-					if (!is_paused) {
-						move_frog_backward();
-						play_sound_frog_move();
-					}
-				} else if (button_held_down == 0) {
-					if (!is_paused) {
-						move_frog_to_right();
-						play_sound_frog_move();
-					}
+		// Pause/unpause the game until 'p' or 'P' is
+		// pressed again
+		is_paused = ~is_paused;
+	} else if(serial_input == 't' || serial_input == 'T') {
+		// Show (and reset) the task overrun statistics
+		print_task_stats();
+	} else if(serial_input == 'c' || serial_input == 'C') {
+		// Show (and reset) the LED matrix traffic counters
+		print_display_stats();
+	} else if(serial_input == 'h' || serial_input == 'H') {
+		// Show (and reset) the main loop latency histogram
+		print_loop_profile();
+	} else if(serial_input == 'w' || serial_input == 'W') {
+		// Start/stop writing the input log to the serial port
+		input_set_streaming(!input_is_streaming());
+	} else if(serial_input == 'a' || serial_input == 'A') {
+		// Turn the autopilot on/off
+		autopilot_on = !autopilot_on;
+		show_autopilot();
+	}
+	// else - invalid input or we're part way through an escape sequence -
+	// do nothing
+	
+	// Find whether a button is currently being held down
+	int8_t button_held_down;
+	uint8_t buttons_held = input_buttons_held();
+	if (buttons_held == 0b00000001) {
+		// B0 is being pushed
+		button_held_down = 0;
+	} else if (buttons_held == 0b00000010) {
+		// B1 is being pushed
+		button_held_down = 1;
+	} else if (buttons_held == 0b00000100) {
+		// B2 is being pushed
+		button_held_down = 2;
+	} else if (buttons_held == 0b00001000) {
+		// B3 is being pushed
+		button_held_down = 3;
+	} else {
+		// No button is being pushed
+		button_held_down = -2;
+	}
+	
+	if (last_button_pushed_at && button_held_down != -2) {
+		// Avoids registering movement just after game begins
+		if (current_time > last_button_pushed_at + BUTTON_HOLD_DELAY) {
+			if (button_held_down == 3) {
+				if (frog_can_move()) {
+					move_frog_to_left();
+					play_sound_frog_move();
 				}
-				last_button_pushed_at = current_time;
-			}
-		}
-		
-		// Deal with joystick movement
-		uint8_t direction;
-		direction = poll_joystick_direction();
-		current_time = get_current_time();
-		
-		if (joystick_last_direction != direction && current_time >= joystick_last_moved + joystick_change_dir_delay) {
-			// Has the joystick direction changed since last time?
-			if (!is_paused) {
-				if (joystick_move(direction)) {
+			} else if (button_held_down == 2) {
+				if (frog_can_move()) {
+					move_frog_forward();
 					play_sound_frog_move();
-					joystick_last_moved = current_time;
 				}
-			}
-			joystick_last_direction = direction;
-		} else if (current_time >= joystick_last_moved + joystick_hold_delay) {
-			// Has the current direction been held for at least joystick_hold_delay ms?
-			if (!is_paused) {
-				if (joystick_move(direction)) {
+			} else if (button_held_down == 1) {
+				if (frog_can_move()) {
+					move_frog_backward();
+					play_sound_frog_move();
+				}
+			} else if (button_held_down == 0) {
+				if (frog_can_move()) {
+					move_frog_to_right();
 					play_sound_frog_move();
-					joystick_last_moved = current_time;
 				}
 			}
+			last_button_pushed_at = current_time;
 		}
-		
-		// Level speed multiplier = x/4 + 3/4 where x is the current level
-		double level_speed_multiplier = (get_level() / 4.0) + (3.0/4.0);
-		current_time = get_current_time();
-		if(!is_frog_dead()) { 
-			// Only check for scroll times if the frog is still alive
-			if (current_time >= last_move_times[0] + scroll_times[0] / level_speed_multiplier) {
-				// scroll_times[x] milliseconds have passed since the last time we moved
-				// this row - move it again and keep track of the time when we did this. 
-				// Only scroll if the game isn't paused
-				if (!is_paused) scroll_vehicle_lane(0, 1);
-				last_move_times[0] = current_time;
-			}
-			if (current_time >= last_move_times[1] + scroll_times[1] / level_speed_multiplier) {
-				if (!is_paused) scroll_vehicle_lane(1, -1);
-				last_move_times[1] = current_time;
-			}
-			if (current_time >= last_move_times[2] + scroll_times[2] / level_speed_multiplier) {
-				if (!is_paused) scroll_vehicle_lane(2, 1);
-				last_move_times[2] = current_time;
-			}
-			if (current_time >= last_move_times[3] + scroll_times[3] / level_speed_multiplier) {
-				if (!is_paused) scroll_river_channel(0, -1);
-				last_move_times[3] = current_time;
+	}
+}
+
+// Deal with joystick movement
+static void joystick_task(uint8_t arg) {
+	uint8_t direction;
+	direction = input_joystick_direction();
+	uint32_t current_time = scheduler_get_time();
+	
+	if (joystick_last_direction != direction && current_time >= joystick_last_moved + JOYSTICK_CHANGE_DIR_DELAY) {
+		// Has the joystick direction changed since last time?
+		if (frog_can_move()) {
+			if (joystick_move(direction)) {
+				play_sound_frog_move();
+				joystick_last_moved = current_time;
 			}
-			if (current_time >= last_move_times[4] + scroll_times[4] / level_speed_multiplier) {
-				if (!is_paused) scroll_river_channel(1, 1);
-				last_move_times[4] = current_time;
+		}
+		joystick_last_direction = direction;
+	} else if (current_time >= joystick_last_moved + JOYSTICK_HOLD_DELAY) {
+		// Has the current direction been held for at least JOYSTICK_HOLD_DELAY ms?
+		if (frog_can_move()) {
+			if (joystick_move(direction)) {
+				play_sound_frog_move();
+				joystick_last_moved = current_time;
 			}
 		}
-		
-		// Update the seven segment display with the time remaining this life
-		uint32_t time_remaining;
-		if (is_paused) {
-			// Time remaining = [time limit] - [time spent up to pause started]
-			time_remaining = time_limit - (time_pause_began - begin_life_time);
+	}
+}
+
+// Move the lanes of traffic and river channels on by the time since the
+// task last ran, so they keep to their speeds if the task runs a little
+// late. They only move if the frog is still alive, the game isn't paused
+// and no animation is playing. (After a longer hold up, such as the level
+// transition, the rows carry on from where they were rather than 
+// jumping.)
+static void motion_task(uint8_t arg) {
+	uint32_t current_time = scheduler_get_time();
+	uint32_t elapsed = current_time - motion_time;
+	motion_time = current_time;
+	if (!is_frog_dead() && !is_paused && !animation_is_playing()) {
+		advance_moving_rows(elapsed < MOTION_MAX_CATCH_UP ? elapsed : MOTION_MAX_CATCH_UP);
+	}
+}
+
+// Move the frog along the fastest route to the riverbank the solver can
+// find from the current state of the game. The route is worked out again
+// before each move, so we follow the rows even if they aren't quite where
+// the solver expected. On the board the solver only looks a short way
+// ahead (see solver.h) - if no hole is in reach, the frog moves to the
+// furthest row it can stay alive in.
+static void autopilot_task(uint8_t arg) {
+	SolverState state;
+	uint8_t moves[SOLVER_HISTORY_STEPS + 1];
+	
+	if (!autopilot_on || !frog_can_move() || is_frog_dead() || frog_has_reached_riverbank()) {
+		return;
+	}
+	
+	solver_read_game_state(&state);
+	solver_search(get_level_descriptor(), &state, SOLVER_HISTORY_STEPS);
+	if (solver_get_best_route(moves) == 0) {
+		// No way to survive - leave the frog where it is
+		return;
+	}
+	
+	switch (moves[0]) {
+		case SOLVER_MOVE_FORWARD:
+			move_frog_forward();
+			break;
+		case SOLVER_MOVE_BACKWARD:
+			move_frog_backward();
+			break;
+		case SOLVER_MOVE_LEFT:
+			move_frog_to_left();
+			break;
+		case SOLVER_MOVE_RIGHT:
+			move_frog_to_right();
+			break;
+		default:
+			// Wait here
+			return;
+	}
+	play_sound_frog_move();
+}
+
+// Show whether the autopilot is on
+static void show_autopilot(void) {
+	move_cursor(1, 3);
+	if (autopilot_on) {
+		printf_P(PSTR("Autopilot"));
+	} else {
+		clear_to_end_of_line();
+	}
+}
+
+// Update the seven segment display with the time remaining this life
+static void sevenseg_task(uint8_t arg) {
+	uint32_t time_spent;
+	if (is_paused) {
+		// Time spent up to pause started
+		time_spent = time_pause_began - begin_life_time;
+	} else {
+		// Time spent so far
+		time_spent = scheduler_get_time() - begin_life_time;
+	}
+	// (The time may run out while a death is shown)
+	display_ssd(time_spent < TIME_LIMIT ? TIME_LIMIT - time_spent : 0);
+}
+
+// Update the sound effects queue
+static void sound_task(uint8_t arg) {
+	update_sound_effects(is_paused);
+}
+
+// Show how often each task has missed a whole period and how late it has
+// been run, and how much of the time the CPU has been asleep. Then reset
+// the statistics.
+static void print_task_stats(void) {
+	uint8_t line = 17;
+	move_cursor(1, line++);
+	printf_P(PSTR("Task      Overruns  Max late (ms)"));
+	for (TaskId task = 0; task < MAX_TASKS; task++) {
+		if (!scheduler_get_task_name(task)) {
+			continue;
+		}
+		move_cursor(1, line++);
+		printf_P(scheduler_get_task_name(task));
+		move_cursor(11, line - 1);
+		printf_P(PSTR("%8u  %13u"), scheduler_get_overruns(task), 
+				scheduler_get_max_lateness(task));
+	}
+	uint32_t stats_time = scheduler_get_stats_time();
+	uint32_t sleep_time = scheduler_get_sleep_time();
+	move_cursor(1, line++);
+	printf_P(PSTR("Asleep %lu of %lu ms (%lu%%), active %lu ms, %lu sleeps"), 
+			(unsigned long)sleep_time, (unsigned long)stats_time, 
+			(unsigned long)(stats_time ? sleep_time * 100 / stats_time : 0),
+			(unsigned long)(stats_time - sleep_time), 
+			(unsigned long)scheduler_get_sleeps());
+	scheduler_reset_stats();
+}
+
+// Show the number of commands and bytes sent to the LED matrix of each 
+// type and by each caller, and how long we have waited for the SPI queue.
+// With more than one panel, also show the bytes sent to each panel and
+// the number of times we switched between them. Then reset the 
+// statistics.
+static void print_display_stats(void) {
+	uint8_t line = 17;
+	move_cursor(1, line++);
+	clear_to_end_of_line();
+	printf_P(PSTR("Command       Count      Bytes"));
+	for (uint8_t type = 0; type < LEDMATRIX_NUM_COMMAND_TYPES; type++) {
+		move_cursor(1, line++);
+		clear_to_end_of_line();
+		printf_P(ledmatrix_get_command_name(type));
+		move_cursor(11, line - 1);
+		printf_P(PSTR("%9lu  %9lu"), (unsigned long)ledmatrix_get_command_count(type), 
+				(unsigned long)ledmatrix_get_command_bytes(type));
+	}
+	for (uint8_t caller = 0; caller < LEDMATRIX_NUM_CALLERS; caller++) {
+		move_cursor(1, line++);
+		clear_to_end_of_line();
+		printf_P(ledmatrix_get_caller_name(caller));
+		move_cursor(11, line - 1);
+		printf_P(PSTR("%9lu  %9lu"), (unsigned long)ledmatrix_get_caller_count(caller), 
+				(unsigned long)ledmatrix_get_caller_bytes(caller));
+	}
+	move_cursor(1, line++);
+	clear_to_end_of_line();
+	printf_P(PSTR("Waited for SPI %lu us"), (unsigned long)ledmatrix_get_blocked_time());
+#if LEDMATRIX_NUM_PANELS > 1
+	for (uint8_t panel = 0; panel < LEDMATRIX_NUM_PANELS; panel++) {
+		move_cursor(1, line++);
+		clear_to_end_of_line();
+		printf_P(PSTR("panel %u   %20lu"), panel, (unsigned long)ledmatrix_get_panel_bytes(panel));
+	}
+	move_cursor(1, line++);
+	clear_to_end_of_line();
+	printf_P(PSTR("Panel selects %lu"), (unsigned long)ledmatrix_get_panel_selects());
+#endif
+	ledmatrix_reset_stats();
+}
+
+// Show the histogram of main loop iteration times and the longest 
+// iteration (with the tasks it ran). Then reset the profiler.
+static void print_loop_profile(void) {
+	uint8_t line = 17;
+	move_cursor(1, line++);
+	clear_to_end_of_line();
+	printf_P(PSTR("Loop time (us)   Iterations"));
+	for (uint8_t bucket = 0; bucket < PROFILER_NUM_BUCKETS; bucket++) {
+		uint32_t count = profiler_get_bucket(bucket);
+		if (!count) {
+			continue;
+		}
+		// Bucket n holds times from 2^(n-1) to 2^n - 1 us
+		uint32_t low_us = bucket ? (1UL << (bucket - 1)) : 0;
+		move_cursor(1, line++);
+		clear_to_end_of_line();
+		if (bucket == PROFILER_NUM_BUCKETS - 1) {
+			printf_P(PSTR("%7lu+        "), (unsigned long)low_us);
 		} else {
-			// Time remaining = [time limit] - [time spent so far]
-			time_remaining = time_limit - (get_current_time() - begin_life_time);
+			printf_P(PSTR("%7lu-%-7lu "), (unsigned long)low_us, 
+					(unsigned long)(1UL << bucket) - 1);
 		}
-		display_ssd(time_remaining);
-		
-		// Update the sound effects queue
-		update_sound_effects(is_paused);
+		printf_P(PSTR("%10lu"), (unsigned long)count);
 	}
-	// We get here if we have run out of lives
-	// The game is over.
-	
-	// Game has been completed successfully, add 10 to score for last frog
-	// reaching the other side.
-	if (is_riverbank_full() && !is_frog_dead()) {
-		add_to_score(10);
+	move_cursor(1, line++);
+	clear_to_end_of_line();
+	printf_P(PSTR("%lu iterations, longest %lu us:"), 
+			(unsigned long)profiler_get_iterations(),
+			(unsigned long)profiler_get_worst_duration());
+	uint16_t work = profiler_get_worst_work();
+	for (TaskId task = 0; task < MAX_TASKS; task++) {
+		if ((work & (1 << task)) && scheduler_get_task_name(task)) {
+			printf_P(PSTR(" "));
+			printf_P(scheduler_get_task_name(task));
+		}
+	}
+	profiler_reset();
+}
+
+// Load a line of an input log to be replayed (after its '#' has been
+// read - see scroll_input_task())
+static void load_replay_log(void) {
+	if (input_load_replay_line()) {
+		move_cursor(10, 5);
+		printf_P(PSTR("Replay loaded - press a button to play it"));
 	}
 }
 
@@ -528,11 +866,15 @@ void handle_game_over() {
 	clear_serial_input_buffer();
 	
 	move_cursor(13,4);
-	printf_P(PSTR("Press a button to start again"));
-	while(button_pushed() == NO_BUTTON_PUSHED) {
-		update_sound_effects(0); // and wait
-	}
+	printf_P(PSTR("Press a button or key to start again"));
 	
+	// Scroll the result on the LED matrix and wait
+	ledmatrix_clear();
+	scroller_clear_messages();
+	scroller_queue_message(PSTR("GAME OVER"), COLOUR_RED, 0);
+	scroller_queue_message(PSTR("SCORE #"), COLOUR_YELLOW, get_score);
+	scroller_queue_message(PSTR("LEVEL #"), COLOUR_ORANGE, get_level_value);
+	scroll_until_input();
 }
 
 static void draw_splash_frog(void) {
@@ -0,0 +1,237 @@
+/*
+ * scheduler.c
+ *
+ * Cooperative deadline scheduler - see scheduler.h
+ */
+
+#include <stdint.h>
+
+#include "hal.h"
+#include "scheduler.h"
+#include "timer0.h"
+
+typedef struct {
+	TaskFunction function;
+	const char* name;	// in program memory, null if the slot is free
+	uint32_t deadline;	// time (ms) at which the task is next due
+	uint16_t period;	// 0 for a one-shot task
+	uint16_t overruns;
+	uint16_t max_lateness;
+	uint8_t arg;
+} Task;
+
+static Task tasks[MAX_TASKS];
+
+// Identifiers of the scheduled tasks in order of deadline (earliest first).
+// Tasks with the same deadline are kept in the order they were scheduled.
+static TaskId run_order[MAX_TASKS];
+static uint8_t num_scheduled;
+
+// Time at which the current pass of scheduler_run_due() started
+static uint32_t pass_time;
+
+// Tasks run by the last pass of scheduler_run_due() (bit n for task n)
+static uint16_t tasks_run_mask;
+
+// Sleep statistics (see scheduler_get_sleep_time())
+static uint32_t stats_start_time;
+static uint32_t sleep_time;
+static uint32_t sleeps;
+
+// Return 1 if time a is before time b. (The clock wraps around after
+// ~49 days so we compare the difference rather than the values.)
+static uint8_t is_before(uint32_t a, uint32_t b) {
+	return (int32_t)(a - b) < 0;
+}
+
+// Insert the task into the run order according to its deadline
+static void insert_in_run_order(TaskId task) {
+	uint8_t i = num_scheduled;
+	// Move later tasks along to make room
+	while(i > 0 && is_before(tasks[task].deadline, tasks[run_order[i-1]].deadline)) {
+		run_order[i] = run_order[i-1];
+		i--;
+	}
+	run_order[i] = task;
+	num_scheduled++;
+}
+
+// Remove the task from the run order (if it is there)
+static void remove_from_run_order(TaskId task) {
+	uint8_t i;
+	for(i = 0; i < num_scheduled; i++) {
+		if(run_order[i] == task) {
+			break;
+		}
+	}
+	if(i == num_scheduled) {
+		return;
+	}
+	for(; i < num_scheduled - 1; i++) {
+		run_order[i] = run_order[i+1];
+	}
+	num_scheduled--;
+}
+
+static TaskId add_task(const char* name, TaskFunction function, uint8_t arg,
+		uint16_t period, uint16_t delay) {
+	TaskId task;
+	for(task = 0; task < MAX_TASKS; task++) {
+		if(!tasks[task].name) {
+			break;
+		}
+	}
+	if(task == MAX_TASKS) {
+		return NO_TASK;
+	}
+	tasks[task].function = function;
+	tasks[task].name = name;
+	tasks[task].arg = arg;
+	tasks[task].period = period;
+	tasks[task].deadline = get_current_time() + delay;
+	tasks[task].overruns = 0;
+	tasks[task].max_lateness = 0;
+	insert_in_run_order(task);
+	return task;
+}
+
+void init_scheduler(void) {
+	for(TaskId task = 0; task < MAX_TASKS; task++) {
+		tasks[task].name = 0;
+	}
+	num_scheduled = 0;
+	scheduler_reset_stats();
+}
+
+TaskId scheduler_add_periodic(const char* name, TaskFunction function,
+		uint8_t arg, uint16_t period, uint16_t first_delay) {
+	if(period == 0) {
+		return NO_TASK;
+	}
+	return add_task(name, function, arg, period, first_delay);
+}
+
+TaskId scheduler_add_one_shot(const char* name, TaskFunction function,
+		uint8_t arg, uint16_t delay) {
+	return add_task(name, function, arg, 0, delay);
+}
+
+void scheduler_remove_task(TaskId task) {
+	if(task < 0 || task >= MAX_TASKS || !tasks[task].name) {
+		return;
+	}
+	remove_from_run_order(task);
+	tasks[task].name = 0;
+}
+
+void scheduler_set_period(TaskId task, uint16_t period) {
+	if(task < 0 || task >= MAX_TASKS || !tasks[task].name ||
+			tasks[task].period == 0 || period == 0) {
+		return;
+	}
+	tasks[task].period = period;
+}
+
+uint8_t scheduler_run_due(void) {
+	uint8_t tasks_run = 0;
+	pass_time = get_current_time();
+	tasks_run_mask = 0;
+
+	// Tasks which become due while we're running tasks are left for the
+	// next pass, so this loop always finishes.
+	while(num_scheduled > 0 && !is_before(pass_time, tasks[run_order[0]].deadline)) {
+		TaskId task = run_order[0];
+		Task* t = &tasks[task];
+		uint32_t lateness = pass_time - t->deadline;
+
+		if(lateness > t->max_lateness) {
+			t->max_lateness = lateness > UINT16_MAX ? UINT16_MAX : lateness;
+		}
+
+		// Take the task off the front of the run order and reschedule
+		// it (if periodic) before running it - so the task can remove
+		// itself or change its own period.
+		remove_from_run_order(task);
+		tasks_run_mask |= 1 << task;
+		if(t->period) {
+			t->deadline += t->period;
+			if(!is_before(pass_time, t->deadline)) {
+				// Missed at least one whole period - skip the missed runs
+				if(t->overruns < UINT16_MAX) {
+					t->overruns++;
+				}
+				t->deadline = pass_time + t->period;
+			}
+			insert_in_run_order(task);
+			t->function(t->arg);
+		} else {
+			// One-shot task - free the slot before running it so the
+			// task can schedule itself again
+			TaskFunction function = t->function;
+			uint8_t arg = t->arg;
+			t->name = 0;
+			function(arg);
+		}
+		tasks_run++;
+	}
+	return tasks_run;
+}
+
+// Return 1 if the first task in the run order is due. Called by
+// hal_idle_sleep() with interrupts disabled.
+static uint8_t is_task_due(void) {
+	return num_scheduled > 0 && 
+			!is_before(get_current_time(), tasks[run_order[0]].deadline);
+}
+
+void scheduler_idle(void) {
+	uint32_t now = get_current_time();
+	if(!hal_idle_sleep(is_task_due)) {
+		// A task is due
+		return;
+	}
+	sleep_time += get_current_time() - now;
+	sleeps++;
+}
+
+uint32_t scheduler_get_time(void) {
+	return pass_time;
+}
+
+uint16_t scheduler_get_tasks_run(void) {
+	return tasks_run_mask;
+}
+
+const char* scheduler_get_task_name(TaskId task) {
+	return tasks[task].name;
+}
+
+uint16_t scheduler_get_overruns(TaskId task) {
+	return tasks[task].overruns;
+}
+
+uint16_t scheduler_get_max_lateness(TaskId task) {
+	return tasks[task].max_lateness;
+}
+
+void scheduler_reset_stats(void) {
+	for(TaskId task = 0; task < MAX_TASKS; task++) {
+		tasks[task].overruns = 0;
+		tasks[task].max_lateness = 0;
+	}
+	stats_start_time = get_current_time();
+	sleep_time = 0;
+	sleeps = 0;
+}
+
+uint32_t scheduler_get_stats_time(void) {
+	return get_current_time() - stats_start_time;
+}
+
+uint32_t scheduler_get_sleep_time(void) {
+	return sleep_time;
+}
+
+uint32_t scheduler_get_sleeps(void) {
+	return sleeps;
+}
@@ -0,0 +1,91 @@
+/*
+ * scheduler.h
+ *
+ * A small cooperative scheduler built on the timer0 millisecond clock.
+ *
+ * Tasks are functions that are run when they become due - either
+ * periodically or once only (one-shot tasks). The scheduled tasks are
+ * kept in order of their next deadline, so each pass of the main loop
+ * only has to look at the first task to know whether anything is due.
+ * Tasks are not pre-empted - they run to completion and should be kept
+ * short.
+ *
+ * A periodic task is next due one period after its previous deadline.
+ * If it ran so late that this time has already passed, the missed runs
+ * are skipped (not run in a burst), the task is rescheduled one period
+ * from now and an overrun is recorded against it.
+ */
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+
+// Maximum number of tasks that can be scheduled at once (at most 16 - see
+// scheduler_get_tasks_run())
+#define MAX_TASKS 12
+
+// Task identifier returned when a task is added
+typedef int8_t TaskId;
+#define NO_TASK (-1)
+
+// Tasks are passed the argument given when the task was added
+typedef void (*TaskFunction)(uint8_t arg);
+
+// Remove all tasks
+void init_scheduler(void);
+
+// Add a task which is first run after first_delay ms and then every
+// period ms. name is a string in program memory (use PSTR()) used when
+// reporting task statistics. Returns NO_TASK if there is no room.
+TaskId scheduler_add_periodic(const char* name, TaskFunction function,
+		uint8_t arg, uint16_t period, uint16_t first_delay);
+
+// Add a task which is run once, after delay ms. The task is removed
+// once it has run. Returns NO_TASK if there is no room.
+TaskId scheduler_add_one_shot(const char* name, TaskFunction function,
+		uint8_t arg, uint16_t delay);
+
+// Remove a task (if it hasn't already run/been removed)
+void scheduler_remove_task(TaskId task);
+
+// Change the period of a periodic task. The new period applies from the
+// task's next deadline.
+void scheduler_set_period(TaskId task, uint16_t period);
+
+// Run every task that is due. Returns the number of tasks run.
+uint8_t scheduler_run_due(void);
+
+// If no task is due, put the CPU to sleep until the next interrupt. The
+// timer0 tick wakes us at least every millisecond. The deadline is
+// checked with interrupts disabled (see hal_idle_sleep()), so a tick
+// arriving between the check and going to sleep wakes us straight away
+// rather than leaving a due task waiting for the following tick.
+void scheduler_idle(void);
+
+// Time (ms) at which the current pass of scheduler_run_due() started.
+// Tasks can use this rather than reading the clock themselves.
+uint32_t scheduler_get_time(void);
+
+// Bit mask of the tasks run by the last pass of scheduler_run_due() - 
+// bit n is set if task n was run.
+uint16_t scheduler_get_tasks_run(void);
+
+// Task statistics. Tasks are numbered 0 to MAX_TASKS-1 - slots which
+// are not in use have a null name. The overrun count is the number of
+// times the task missed a whole period. The maximum lateness is the
+// largest time (ms) between a deadline and the task being run.
+const char* scheduler_get_task_name(TaskId task);
+uint16_t scheduler_get_overruns(TaskId task);
+uint16_t scheduler_get_max_lateness(TaskId task);
+void scheduler_reset_stats(void);
+
+// Sleep statistics since the statistics were last reset: the time (ms)
+// covered, how much of it was spent asleep and the number of times we
+// went to sleep. The time asleep is counted in whole timer0 ticks - a
+// tick is counted as asleep if the CPU was asleep when it arrived.
+uint32_t scheduler_get_stats_time(void);
+uint32_t scheduler_get_sleep_time(void);
+uint32_t scheduler_get_sleeps(void);
+
+#endif /* SCHEDULER_H_ */
@@ -5,10 +5,9 @@
  */
 
 #include "score.h"
+#include "hal.h"
 #include "terminalio.h"
 #include <stdio.h>
-#include <avr/io.h>
-#include <avr/pgmspace.h>
 
 uint16_t score;
 
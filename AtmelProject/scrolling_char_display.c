@@ -4,9 +4,10 @@
  * Author: Peter Sutton
  *
  * This is an example of how the LED display board can be used. 
- * This program scrolls a message from right to left on the
- * board. The font used is defined below and is 7 dots high and
- * varies between 3 and 5 dots wide, depending on the character.
+ * This program scrolls a queue of messages from right to left on
+ * the board, as a scheduler task. The font used is defined below
+ * and is 7 dots high and varies between 3 and 5 dots wide, 
+ * depending on the character.
  * Letters and numbers can be handled (though lower case
  * letters are displayed as upper case). All other characters
  * display as a blank column.
@@ -24,8 +25,10 @@
  */
 
 #include "scrolling_char_display.h"
+#include "hal.h"
 #include "ledmatrix.h"
-#include <avr/pgmspace.h>
+#include "scheduler.h"
+#include "timer0.h"
 
 /* FONT DEFINITION
  *
@@ -104,36 +107,174 @@ static const uint8_t* const numbers[10] PROGMEM = {
 		cols_0, cols_1, cols_2, cols_3, cols_4, 
 		cols_5, cols_6, cols_7, cols_8, cols_9 };
 
-/* Keep track of the pixel colour to be used */
-static PixelColour colour = COLOUR_RED;
+/*
+ * Get the font data for a character (in program memory), or 0 if
+ * it's shown as a blank column
+ */
+static const uint8_t* font_columns(char c) {
+	if (c >= 'a' && c <= 'z') {
+		/* Character is a lower case letter - shown as upper case */
+		return (const uint8_t*)pgm_read_ptr(&letters[c - 'a']);
+	} else if (c >= 'A' && c <= 'Z') {
+		/* Upper case character */
+		return (const uint8_t*)pgm_read_ptr(&letters[c - 'A']);
+	} else if (c >= '0' && c <= '9') {
+		/* Digit */
+		return (const uint8_t*)pgm_read_ptr(&numbers[c - '0']);
+	}
+	return 0;
+}
+
+/* Number of blank columns between one message and the next */
+#define MESSAGE_GAP 6
+
+/* The queue of messages to be displayed. message_num is the
+ * message being displayed (or next to be displayed).
+ */
+typedef struct {
+	const char* text;
+	PaletteIndex colour;
+	ScrollerValueFunction value;
+} ScrollerMessage;
+
+static ScrollerMessage messages[SCROLLER_MAX_MESSAGES];
+static uint8_t num_messages;
+static uint8_t message_num;
+
+/* Keep track of the pixel colour to be used (an entry of the LED
+ * matrix palette)
+ */
+static PaletteIndex colour;
 
 /* Keep track of which column of data is next to be displayed. 
  * next_col_ptr points to that column, or is 0 if there is
  * no next column.
  */
-static volatile const uint8_t* next_col_ptr = 0;
+static const uint8_t* next_col_ptr;
+
+/* Next character of the message to be displayed (in program 
+ * memory), or 0 if we're not part way through a message.
+ */
+static const char* next_char_to_display;
 
-/* String to be displayed. 
- * next_char_to_display will be used to point to the next
- * character from this string to be displayed.
+/* Digits of a value being displayed, and the next one to be
+ * displayed (value_text[value_digit] is 0 if there are none left)
  */
-static char* display_string;
+static char value_text[6];
+static uint8_t value_digit;
 
-static volatile char* next_char_to_display = 0;
+/* Number of blank columns to be displayed before we move on */
+static uint8_t blank_columns;
 
-/*
- * Set the message to be displayed - we just copy the 
- * pointer not the string it points to, so it is important
- * that the original string not change after this function
- * is called while the string is still being displayed.
- * We reset the pointers to ensure the next column to be displayed
- * comes from the first character of this string.
- */
-void set_scrolling_display_text(char* string_to_display, PixelColour c) {
-	colour = c;
-	display_string = string_to_display;
+/* The scrolling task (if it's running) and whether it starts the
+ * messages again when they're done
+ */
+static TaskId scroller_task_id = NO_TASK;
+static uint8_t repeat_messages;
+
+/* PRERENDERED MESSAGES
+ * The bitmap holds the font data of each column (with bit 0 clear),
+ * including the gap after each message (render_overflow is set if
+ * they didn't all fit). The colour of each column is that of the 
+ * message it is in - the first column of each message is kept.
+ */
+static uint8_t bitmap[SCROLLER_BITMAP_COLUMNS];
+static uint16_t bitmap_length;
+static uint8_t render_overflow;
+static uint8_t rendered_messages;
+static uint16_t rendered_start[SCROLLER_MAX_MESSAGES];
+static PaletteIndex rendered_colour[SCROLLER_MAX_MESSAGES];
+
+/* The window last shown (if window_shown is 1), and the window 
+ * being scrolled to. window_fraction is how far it has moved past
+ * window_offset, in 1/PIXEL_FRACTION pixels - the speed (subpixels 
+ * per second) times the ms it has been moving.
+ */
+static int16_t shown_offset;
+static uint8_t window_shown;
+static int16_t window_offset;
+static int32_t window_fraction;
+static int16_t window_speed;
+static uint32_t window_moved_at;
+
+/* How often (ms) the rendered messages are moved */
+#define RENDERED_TASK_PERIOD 10
+#define PIXEL_FRACTION ((int32_t)SCROLLER_SUBPIXELS * 1000)
+
+/* Bytes sent to the LED matrix for each command (see ledmatrix.c) */
+#define PIXEL_BYTES 3
+#define COLUMN_BYTES 10
+#define SHIFT_BYTES 2
+
+/* Go back to the start of the first message */
+static void rewind_messages(void) {
+	message_num = 0;
 	next_col_ptr = 0;
 	next_char_to_display = 0;
+	value_text[0] = 0;
+	value_digit = 0;
+	blank_columns = 0;
+}
+
+void scroller_clear_messages(void) {
+	num_messages = 0;
+	rewind_messages();
+}
+
+uint8_t scroller_queue_message(const char* text, PixelColour c,
+		ScrollerValueFunction value) {
+	if(num_messages >= SCROLLER_MAX_MESSAGES) {
+		return 0;
+	}
+	messages[num_messages].text = text;
+	messages[num_messages].colour = ledmatrix_palette_index(c);
+	messages[num_messages].value = value;
+	num_messages++;
+	return 1;
+}
+
+/*
+ * Get the next character of the message being displayed, or 0 at 
+ * the end of it. A value character is replaced by the digits of the
+ * value as it is now.
+ */
+static char next_message_char(void) {
+	char next_char;
+	if(value_text[value_digit]) {
+		return value_text[value_digit++];
+	}
+	next_char = pgm_read_byte(next_char_to_display++);
+	if(next_char == SCROLLER_VALUE_CHAR && messages[message_num].value) {
+		uint16_t value = messages[message_num].value();
+		/* Write the digits into the end of value_text, most
+		 * significant first
+		 */
+		value_digit = sizeof(value_text) - 1;
+		do {
+			value_text[--value_digit] = '0' + value % 10;
+			value /= 10;
+		} while(value);
+		next_char = value_text[value_digit++];
+	}
+	return next_char;
+}
+
+/*
+ * Show a column of font data in column x of the display, in the
+ * given colour
+ */
+static void update_column(uint8_t x, uint8_t col_data, PaletteIndex c) {
+	MatrixColumn column_colour_data;
+	set_matrix_column_to_colour(column_colour_data, 0);
+	for(uint8_t i=7; i>=1; i--) {
+		// If the relevant font bit is set, we make this a pixel of our
+		// colour, otherwise blank
+		if(col_data & 0x80) {
+			SET_MATRIX_PIXEL(column_colour_data, i, c);
+		}
+		col_data <<= 1;
+	}
+	ledmatrix_update_column(x, column_colour_data);
 }
 
 /*
@@ -142,11 +283,8 @@ void set_scrolling_display_text(char* string_to_display, PixelColour c) {
  * Returns 1 if still scrolling display.
  */
 uint8_t scroll_display(void) {
-	static uint8_t shift_countdown = 0;
-	uint8_t i;
 	uint8_t col_data;
 	char next_char;
-	uint8_t finished = 0;
 
 	/* Data to be displayed in the next column - by 
 	 * default we show a blank column. Bit 7 of this
@@ -173,75 +311,328 @@ uint8_t scroll_display(void) {
 			 */
 			next_col_ptr++;
 		}
+	} else if(blank_columns) {
+		/* We're leaving a gap after a message */
+		blank_columns--;
 	} else if(next_char_to_display) {
 		/* We're not currently outputting a character, but we
 		 * do have more characters to display. We will output
 		 * a blank column this time (col_data value remains 0)
 		 * but we will set up our pointer (next_col_ptr) so that
 		 * it points to the data for the first column of dots for
-		 * the next character. We first get the next character to be 
-		 * displayed and advance our next character pointer 
-		 * (next_char_to_display) so that it points to the character 
-		 * after.
+		 * the next character. 
 		 */
-		next_char = *(next_char_to_display++);
+		next_char = next_message_char();
 		if(next_char == 0) {
-			/* We reached the null character at the end of the string.
-			 * There is no next character, reset our pointer to 
-			 * the next character and set our countdown until the 
-			 * message disappears from the display.
+			/* We reached the null character at the end of the message.
+			 * Leave a gap before the next message, or if this was the
+			 * last one, let it scroll off the display.
 			 */
 			next_char_to_display = 0;
-			shift_countdown = 16;
-		} else if (next_char >= 'a' && next_char <= 'z') {
-			/* Character is a lower case letter - the next column to 
-			 * be displayed will be the first column of the letter
-			 * data for that letter
+			message_num++;
+			blank_columns = (message_num < num_messages) ? 
+					MESSAGE_GAP - 1 : MATRIX_NUM_COLUMNS - 1;
+		} else {
+			/* The next column to be displayed will be the first 
+			 * column of the font data for the character (if any)
 			 */
-			next_col_ptr = (const uint8_t*)pgm_read_word(&letters[next_char - 'a']);
-		} else if (next_char >= 'A' && next_char <= 'Z') {
-			/* Upper case character */
-			next_col_ptr = (const uint8_t*)pgm_read_word(&letters[next_char - 'A']);
-		} else if (next_char >= '0' && next_char <= '9') {
-			/* Digit */
-			next_col_ptr = (const uint8_t*)pgm_read_word(&numbers[next_char - '0']);
+			next_col_ptr = font_columns(next_char);
 		}
 	} else {
 		/* We're not outputting a column of dots and there is 
-		 * no next character. Move on to the string that we
-		 * have stored (if any).
+		 * no next character. Move on to the next message in the
+		 * queue (if any) - or back to the first one if they are
+		 * to be repeated. 
 		 */
-		if(!display_string) {
-			/* May be finished - flag this and adjust below if we're still
-			 * showing pixels
-			 */
-			finished = 1;
+		if(message_num >= num_messages) {
+			if(!repeat_messages || num_messages == 0) {
+				/* Finished - the last message has scrolled off */
+				return 0;
+			}
+			message_num = 0;
 		}
-		next_char_to_display = display_string;
-		display_string = 0;
+		next_char_to_display = messages[message_num].text;
+		colour = messages[message_num].colour;
 	}
 	
 	/* Shift the current display one pixel to the left and insert the 
-	 * new column data at column 15.
-	 * Adjust our "finished" variable if we've finished scrolling the
-	 * message off the display
+	 * new column data at the rightmost column. The message is shown on
+	 * the bottom 8 rows.
 	 */
+	uint8_t previous_caller = ledmatrix_set_caller(LEDMATRIX_CALLER_SCROLLER);
 	ledmatrix_shift_display_left();
-	MatrixColumn column_colour_data;
-	for(i=7; i>=1; i--) {
-		// If the relevant font bit is set, we make this a red pixel, otherwise blank
-		if(col_data & 0x80) {
-			column_colour_data[i] = colour;
-		} else {
-			column_colour_data[i] = 0;
+	update_column(MATRIX_NUM_COLUMNS - 1, col_data, colour);
+	// Make sure the shift and the new column have reached the display
+	// before we return
+	ledmatrix_flush();
+	ledmatrix_set_caller(previous_caller);
+	return 1;
+}
+
+/*
+ * The scrolling task - scroll one pixel, and remove the task when
+ * the messages are done.
+ */
+static void scroller_task(uint8_t arg) {
+	if(!scroll_display()) {
+		scroller_stop();
+	}
+}
+
+/* Time (ms) between pixels at the given rate */
+static uint16_t scroll_period(uint8_t rate) {
+	return rate ? 1000 / rate : 1000;
+}
+
+uint8_t scroller_start(uint8_t rate, uint8_t repeat) {
+	scroller_stop();
+	rewind_messages();
+	repeat_messages = repeat;
+	scroller_task_id = scheduler_add_periodic(PSTR("scroller"), scroller_task, 0,
+			scroll_period(rate), 0);
+	return scroller_task_id != NO_TASK;
+}
+
+void scroller_set_rate(uint8_t rate) {
+	if(scroller_task_id != NO_TASK) {
+		scheduler_set_period(scroller_task_id, scroll_period(rate));
+	}
+}
+
+void scroller_stop(void) {
+	if(scroller_task_id != NO_TASK) {
+		scheduler_remove_task(scroller_task_id);
+		scroller_task_id = NO_TASK;
+	}
+}
+
+uint8_t scroller_is_scrolling(void) {
+	return scroller_task_id != NO_TASK;
+}
+
+/*
+ * Add a column to the end of the bitmap, if there's room
+ */
+static void render_column(uint8_t col_data) {
+	if(bitmap_length < SCROLLER_BITMAP_COLUMNS) {
+		bitmap[bitmap_length++] = col_data & 0xFE;
+	} else {
+		render_overflow = 1;
+	}
+}
+
+uint8_t scroller_render(void) {
+	const uint8_t* col_ptr;
+	uint8_t col_data;
+	char next_char;
+
+	bitmap_length = 0;
+	render_overflow = 0;
+	window_shown = 0;
+	rewind_messages();
+	for(message_num = 0; message_num < num_messages; message_num++) {
+		rendered_start[message_num] = bitmap_length;
+		rendered_colour[message_num] = messages[message_num].colour;
+		next_char_to_display = messages[message_num].text;
+		while((next_char = next_message_char())) {
+			/* A blank column, then the columns of the character */
+			render_column(0);
+			col_ptr = font_columns(next_char);
+			while(col_ptr) {
+				col_data = pgm_read_byte(col_ptr++);
+				render_column(col_data);
+				if(col_data & 1) {
+					col_ptr = 0;
+				}
+			}
 		}
-		col_data <<= 1;
+		for(uint8_t i = 0; i < MESSAGE_GAP; i++) {
+			render_column(0);
+		}
+	}
+	rendered_messages = num_messages;
+	rewind_messages();
+	return !render_overflow;
+}
+
+uint16_t scroller_get_rendered_length(void) {
+	return bitmap_length;
+}
+
+/*
+ * Get the font data of bitmap column c (which may be off either end
+ * of the bitmap) and its colour
+ */
+static uint8_t window_column(int16_t c, PaletteIndex* c_colour) {
+	int16_t length = bitmap_length;
+	uint8_t i;
+
+	/* When repeating, the columns in the direction the messages 
+	 * are scrolling from go round again
+	 */
+	if(repeat_messages && length && 
+			(window_speed >= 0 ? c >= 0 : c < length)) {
+		c %= length;
+		if(c < 0) {
+			c += length;
+		}
+	}
+	*c_colour = 0;
+	if(c < 0 || c >= length) {
+		return 0;
+	}
+	for(i = rendered_messages - 1; i > 0 && rendered_start[i] > c; i--) {
+		;
+	}
+	*c_colour = rendered_colour[i];
+	return bitmap[c];
+}
+
+/*
+ * Bytes needed to change a column of the display from showing one
+ * column of font data to another - those pixels turned on or off, and
+ * those which stay on in a different colour
+ */
+static uint8_t column_cost(uint8_t old_data, PaletteIndex old_colour,
+		uint8_t new_data, PaletteIndex new_colour) {
+	uint8_t changed = old_data ^ new_data;
+	uint8_t bytes = 0;
+	if(old_colour != new_colour) {
+		changed |= old_data & new_data;
+	}
+	for(; changed; changed &= changed - 1) {
+		bytes += PIXEL_BYTES;
 	}
-	column_colour_data[0] = 0;
-	ledmatrix_update_column(15, column_colour_data);
-	if(shift_countdown > 0) {
-		shift_countdown--;
+	return (bytes < COLUMN_BYTES) ? bytes : COLUMN_BYTES;
+}
+
+/*
+ * Work out the bytes needed to change the display from the window at
+ * from, shifted left shift columns (right if negative), to the window
+ * at to. Only the rows the messages are on are counted.
+ */
+static uint16_t window_cost(int16_t from, int8_t shift, int16_t to) {
+	uint16_t bytes = 0;
+	uint8_t old_data, new_data;
+	PaletteIndex old_colour, new_colour;
+	
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		int16_t from_x = x + shift;
+		old_data = 0;
+		old_colour = 0;
+		if(from_x >= 0 && from_x < MATRIX_NUM_COLUMNS) {
+			old_data = window_column(from + from_x, &old_colour);
+		}
+		new_data = window_column(to + x, &new_colour);
+		bytes += column_cost(old_data, old_colour, new_data, new_colour);
+	}
+	
+	/* Each shift is sent to each panel the messages are on. The 
+	 * column shifted from one panel into the next is then sent to
+	 * the next panel (one column is shifted on at each step).
+	 */
+	for(uint8_t step = 0; step < ((shift > 0) ? shift : -shift); step++) {
+		bytes += SHIFT_BYTES * LEDMATRIX_PANELS_X;
+		for(uint8_t edge = PANEL_NUM_COLUMNS; edge < MATRIX_NUM_COLUMNS; 
+				edge += PANEL_NUM_COLUMNS) {
+			int16_t from_x = (shift > 0) ? edge + step : edge - 1 - step;
+			if(from_x < MATRIX_NUM_COLUMNS && from_x >= 0) {
+				old_data = window_column(from + from_x, &old_colour);
+				bytes += column_cost(0, 0, old_data, old_colour);
+			}
+		}
+	}
+	return bytes;
+}
+
+void scroller_show_window(int16_t offset) {
+	uint8_t previous_caller = ledmatrix_set_caller(LEDMATRIX_CALLER_SCROLLER);
+	
+	/* If the new window overlaps the last one, see if it's fewer 
+	 * bytes to shift the columns they have in common into place
+	 * first
+	 */
+	if(window_shown && offset != shown_offset &&
+			offset - shown_offset > -MATRIX_NUM_COLUMNS &&
+			offset - shown_offset < MATRIX_NUM_COLUMNS) {
+		int8_t shift = offset - shown_offset;
+		if(window_cost(shown_offset, shift, offset) < 
+				window_cost(shown_offset, 0, offset)) {
+			for(; shift > 0; shift--) {
+				ledmatrix_shift_display_left();
+			}
+			for(; shift < 0; shift++) {
+				ledmatrix_shift_display_right();
+			}
+		}
+	}
+	
+	/* Bring every column up to date - only the pixels which differ 
+	 * from what is shown are sent
+	 */
+	for(uint8_t x = 0; x < MATRIX_NUM_COLUMNS; x++) {
+		PaletteIndex c;
+		uint8_t col_data = window_column(offset + x, &c);
+		update_column(x, col_data, c);
+	}
+	ledmatrix_flush();
+	ledmatrix_set_caller(previous_caller);
+	shown_offset = offset;
+	window_shown = 1;
+}
+
+/*
+ * The rendered scrolling task - move the window on by the time since
+ * it was last moved, and show it if it has moved a whole column. The
+ * task removes itself when the messages have scrolled off (unless 
+ * they are being repeated).
+ */
+static void rendered_scroller_task(uint8_t arg) {
+	uint32_t current_time = scheduler_get_time();
+	int16_t length = bitmap_length;
+	
+	window_fraction += (int32_t)window_speed * (int32_t)(current_time - window_moved_at);
+	window_moved_at = current_time;
+	window_offset += window_fraction / PIXEL_FRACTION;
+	window_fraction %= PIXEL_FRACTION;
+	
+	if(repeat_messages) {
+		/* Go back round once both the window and the window shown
+		 * are past the end (so the windows compared by 
+		 * scroller_show_window() are still next to each other)
+		 */
+		if(window_offset >= length && shown_offset >= length) {
+			window_offset -= length;
+			shown_offset -= length;
+		} else if(window_offset <= -MATRIX_NUM_COLUMNS && 
+				shown_offset <= -MATRIX_NUM_COLUMNS) {
+			window_offset += length;
+			shown_offset += length;
+		}
+	} else if(window_speed >= 0 ? window_offset >= length : 
+			window_offset <= -MATRIX_NUM_COLUMNS) {
+		/* Finished - the messages have scrolled off */
+		scroller_show_window(window_offset);
+		scroller_stop();
+		return;
+	}
+	if(!window_shown || window_offset != shown_offset) {
+		scroller_show_window(window_offset);
+	}
+}
+
+uint8_t scroller_start_rendered(int16_t speed, uint8_t repeat) {
+	scroller_stop();
+	repeat_messages = repeat;
+	window_speed = speed;
+	window_fraction = 0;
+	window_moved_at = get_current_time();
+	/* The window starts off the end the messages come in from */
+	window_offset = (speed >= 0) ? -MATRIX_NUM_COLUMNS : bitmap_length;
+	if(!bitmap_length) {
+		return 0;
 	}
-	finished = finished && (shift_countdown == 0);
-	return !finished;
+	scroller_task_id = scheduler_add_periodic(PSTR("scroller"), 
+			rendered_scroller_task, 0, RENDERED_TASK_PERIOD, 0);
+	return scroller_task_id != NO_TASK;
 }
@@ -10,23 +10,104 @@
 #include <stdint.h>
 #include "pixel_colour.h"
 
-/* Sets the text to be displayed and the colour it will be
- * scrolled with. The message will start displaying immediately
- * so will overwrite/interfere with any currently scrolling
- * message. To avoid this, wait until the scroll_display()
- * function below has returned 0 to indicate the message scrolling
- * is complete. Note that this string is not 
- * copied, so it is important that this string not change
- * after this function is called while the string is still
- * being displayed.
- */
-void set_scrolling_display_text(char* string, PixelColour colour);
-
-/* Scroll the display. Should be called whenever the display
- * is to be scrolled one pixel to the left. It is recommended that
- * this function NOT be called from an interrupt service routine as
- * it will wait for SPI communication to be finished before returning. 
- * This could take over 1ms.
+#define SCROLLER_MAX_MESSAGES 4
+
+/* Character which is shown as the value of a message (see below) */
+#define SCROLLER_VALUE_CHAR '#'
+
+/* Function which returns a value to be shown in a message */
+typedef uint16_t (*ScrollerValueFunction)(void);
+
+/* Removes all the queued messages. Whatever is on the display is
+ * left there (it is scrolled off by the next message).
+ */
+void scroller_clear_messages(void);
+
+/* Adds a message to the end of the queue, to be scrolled in the
+ * given colour (which is looked up in the LED matrix palette - see
+ * ledmatrix_palette_index()). The text must be in program memory
+ * (use PSTR()) - it is not copied. Each SCROLLER_VALUE_CHAR in the
+ * text is shown as the number returned by value (if not 0), read
+ * when that character scrolls on, so the message shows the value
+ * at the time. The messages follow each other with a short gap and
+ * the last one scrolls right off the display.
+ * Returns 0 if the queue is full.
+ */
+uint8_t scroller_queue_message(const char* text, PixelColour colour,
+		ScrollerValueFunction value);
+
+/* Starts scrolling the queued messages (from the first one) as a
+ * scheduler task, at rate pixels per second. If repeat is 1, the
+ * messages start again after the last one has scrolled off,
+ * otherwise the task removes itself at the end.
+ * Returns 0 if the task can't be added.
+ */
+uint8_t scroller_start(uint8_t rate, uint8_t repeat);
+
+/* Changes the scrolling rate (pixels per second) */
+void scroller_set_rate(uint8_t rate);
+
+/* Stops the scrolling task, leaving the display as it is */
+void scroller_stop(void);
+
+/* Returns 1 while the scrolling task is running */
+uint8_t scroller_is_scrolling(void);
+
+/* PRERENDERED MESSAGES
+ * Rather than being looked up in the font a column at a time as they
+ * scroll, the queued messages can be rendered once into a bitmap of
+ * up to SCROLLER_BITMAP_COLUMNS columns (a byte each). Any window of
+ * the bitmap the width of the display can then be shown. The bitmap
+ * can be scrolled at fractional speeds, in either direction and round
+ * and round, without looking at the text again.
+ */
+#ifndef SCROLLER_BITMAP_COLUMNS
+#define SCROLLER_BITMAP_COLUMNS 160
+#endif
+
+/* Speeds of the rendered messages are in 1/SCROLLER_SUBPIXELS pixels
+ * per second
+ */
+#define SCROLLER_SUBPIXELS 16
+
+/* Renders the queued messages into the bitmap. Values in them are
+ * read now. Returns 0 if they don't all fit (the bitmap has as much
+ * as fits).
+ */
+uint8_t scroller_render(void);
+
+/* Returns the number of bitmap columns the messages were rendered
+ * into (including the gap after each one)
+ */
+uint16_t scroller_get_rendered_length(void);
+
+/* Shows the window of the bitmap whose first column is bitmap column
+ * offset. Columns off either end of the bitmap are blank - except 
+ * that while rendered messages are being repeated, the bitmap 
+ * carries on round in the direction they are scrolling. Only the 
+ * columns which change are sent, after shifting the display if that
+ * needs fewer bytes. This assumes that nothing else has drawn on the
+ * display since the last window was shown.
+ */
+void scroller_show_window(int16_t offset);
+
+/* Starts scrolling the rendered messages as a scheduler task. A 
+ * positive speed scrolls right to left (the messages come in from the
+ * right), a negative one left to right. The display starts off blank.
+ * If repeat is 1, the messages carry on round (with a gap between the
+ * last and the first), otherwise the task removes itself when they
+ * have scrolled off. scroller_stop() and scroller_is_scrolling() 
+ * apply to this task too.
+ * Returns 0 if the task can't be added.
+ */
+uint8_t scroller_start_rendered(int16_t speed, uint8_t repeat);
+
+/* Scroll the display one pixel to the left. This is what the 
+ * scrolling task does - it can also be called directly, without 
+ * starting the task. It is recommended that this function NOT be
+ * called from an interrupt service routine as it will wait for SPI
+ * communication to be finished before returning. This could take
+ * over 1ms.
  * Returns 1 while a message is still scrolling, 0 when done.
  */
 uint8_t scroll_display(void);
@@ -7,11 +7,10 @@
  *  Author: maxcmiller
  */ 
 
+#include "hal.h"
 #include "timer0.h"
 
 #include <stdio.h>
-#include <avr/io.h>
-#include <avr/pgmspace.h>
 
 // Seven segment display - segment values for digits 0 to 9 and 0 with a decimal point
 static uint8_t seven_seg[11] = { 63,6,91,79,102,109,125,7,127,111,191};
@@ -20,18 +19,12 @@ static uint8_t current_digit = 0;
 	
 /* Display digit function. Arguments are the digit number (0 to 9)
  * and the digit to display it on (0 = right, 1 = left). The function 
- * outputs the correct seven segment display value to port C and the 
- * correct digit select value to port A, pin 3.
+ * outputs the correct seven segment display value and digit select
+ * value.
  */
 static void display_digit(uint8_t number, uint8_t digit) 
 {
-	// Set port A pin 3 to the digit (1 or 0)
-	if (digit == 1) {
-		PORTA |= (1 << 3);
-	} else {
-		PORTA &= ~(1 << 3);
-	}
-	PORTC = seven_seg[number];	// We assume digit is in range 0 to 9
+	hal_sevenseg_output(seven_seg[number], digit);	// We assume digit is in range 0 to 9
 }
 
 /* Displays the given time_remaining value (in ms) to the seven segment display.
@@ -68,9 +61,5 @@ void display_ssd(uint32_t time_remaining) {
 }
 
 void init_sevenseg(void) {
-	/* Set port C (all pins) to be outputs */
-	DDRC = 0xFF;
-	
-	/* Set port A, pin 3 to be an output */
-	DDRA |= (1 << 3);
+	hal_init_sevenseg();
 }
\ No newline at end of file
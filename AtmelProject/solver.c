@@ -0,0 +1,295 @@
+/*
+ * solver.c
+ *
+ * Route finder for the frog - see solver.h
+ */
+
+#include <stdint.h>
+
+#include "game.h"
+#include "levels.h"
+#include "playfield.h"
+#include "solver.h"
+
+// For the first SOLVER_HISTORY_STEPS steps of the last search: the columns
+// the frog could be in on each row (below the riverbank) at the start of
+// each step, and the number of columns (positive to the right) each river
+// channel carried the frog since the previous step
+static RowMask history[SOLVER_HISTORY_STEPS + 1][RIVERBANK_ROW];
+static int8_t carried[SOLVER_HISTORY_STEPS + 1][NUM_CHANNELS];
+
+// Results of the last search
+static uint8_t arrival_step[BOARD_NUM_COLUMNS];
+static uint8_t last_step;
+
+void solver_start_of_level(const LevelDescriptor* level_data, uint8_t level,
+		SolverState* state) {
+	state->frog_row = START_ROW;
+	state->frog_column = FROG_START_COLUMN;
+	state->riverbank_status = level_data->riverbank;
+	for(uint8_t i = 0; i < NUM_MOVING_ROWS; i++) {
+		state->position[i] = 0;
+		state->phase[i] = 0;
+		state->velocity[i] = level_row_velocity(&level_data->rows[i], level);
+	}
+}
+
+void solver_read_game_state(SolverState* state) {
+	state->frog_row = get_frog_row();
+	state->frog_column = get_frog_column();
+	state->riverbank_status = get_riverbank_status();
+	for(uint8_t i = 0; i < NUM_MOVING_ROWS; i++) {
+		state->position[i] = get_moving_row_position(i);
+		state->phase[i] = get_moving_row_phase(i);
+		state->velocity[i] = get_moving_row_velocity(i);
+	}
+}
+
+// Return the new position of a row after it scrolls one column
+static uint8_t scrolled_position(const LevelRow* row, uint8_t position) {
+	// A direction of 1 (right) means we start from a lower bit position
+	// in column 0 (see scroll_vehicle_lane() in game.c)
+	if(row->direction == 1) {
+		return position ? position - 1 : row->width - 1;
+	} else {
+		return position + 1 < row->width ? position + 1 : 0;
+	}
+}
+
+void solver_advance_state(const LevelDescriptor* level_data, SolverState* state,
+		uint16_t time) {
+	for(uint8_t i = 0; i < NUM_MOVING_ROWS; i++) {
+		// The positions repeat every width scrolls, so only the remainder
+		// matters
+		uint16_t scrolls = level_row_advance(&state->phase[i], state->velocity[i], time);
+		for(scrolls %= level_data->rows[i].width; scrolls > 0; scrolls--) {
+			state->position[i] = scrolled_position(&level_data->rows[i],
+					state->position[i]);
+		}
+	}
+}
+
+// Return the columns covered by the fast vehicle of a row (0 if there is
+// none), with the row at the given position and phase
+static RowMask fast_vehicle_mask(const LevelRow* row, uint8_t position, uint32_t phase) {
+	if(!row->fast_length) {
+		return 0;
+	}
+	return level_span_mask(level_row_fast_column(row, position, phase), 
+			row->fast_length, row->width);
+}
+
+RowMask solver_search(const LevelDescriptor* level_data, const SolverState* state,
+		uint8_t max_steps) {
+	// For each row below the riverbank, the columns the frog could be in
+	// (reachable) and the columns where it would die (death, as in game.c)
+	RowMask reachable[RIVERBANK_ROW];
+	RowMask moved[RIVERBANK_ROW];
+	RowMask death[RIVERBANK_ROW];
+	// The death mask of each moving row without its fast vehicle
+	RowMask pattern_death[NUM_MOVING_ROWS];
+	uint8_t position[NUM_MOVING_ROWS];
+	uint32_t phase[NUM_MOVING_ROWS];
+	RowMask holes = ~state->riverbank_status & ROW_MASK_ALL;
+	RowMask holes_reached = 0;
+	uint8_t step;
+	uint8_t row;
+
+	for(row = START_ROW; row < RIVERBANK_ROW; row++) {
+		reachable[row] = 0;
+		death[row] = 0;
+	}
+	for(uint8_t i = 0; i < NUM_MOVING_ROWS; i++) {
+		position[i] = state->position[i];
+		phase[i] = state->phase[i];
+		pattern_death[i] = level_row_mask(&level_data->rows[i], position[i],
+				i >= FIRST_CHANNEL_INDEX);
+		death[MOVING_ROW(i)] = pattern_death[i] | 
+				fast_vehicle_mask(&level_data->rows[i], position[i], phase[i]);
+	}
+	for(uint8_t column = 0; column < BOARD_NUM_COLUMNS; column++) {
+		arrival_step[column] = SOLVER_UNREACHED;
+	}
+	if(state->frog_row >= START_ROW && state->frog_row < RIVERBANK_ROW) {
+		reachable[state->frog_row] = COLUMN_BIT(state->frog_column) & ~death[state->frog_row];
+	}
+
+	for(step = 0; ; step++) {
+		// Scroll each row as many times as it scrolls since the last step.
+		// A frog on a log moves with it (and is lost off the edge); a frog
+		// hit by a vehicle is lost. The bits above the last column aren't on
+		// the board, so they are masked off after each shift.
+		int8_t carried_by[NUM_CHANNELS] = { 0 };
+		for(uint8_t i = 0; i < NUM_MOVING_ROWS && step > 0; i++) {
+			const LevelRow* moving_row = &level_data->rows[i];
+			uint8_t fast_column = 0;
+			uint16_t fast_moves = 0;
+			if(moving_row->fast_length) {
+				fast_column = level_row_fast_column(moving_row, position[i], phase[i]);
+				fast_moves -= level_phase_columns(phase[i], moving_row->fast_speed);
+			}
+			uint16_t scrolls = level_row_advance(&phase[i], state->velocity[i], 
+					SOLVER_STEP_TIME);
+			row = MOVING_ROW(i);
+			fast_moves += scrolls * moving_row->fast_speed;
+			for(; scrolls > 0; scrolls--) {
+				position[i] = scrolled_position(moving_row, position[i]);
+				if(i >= FIRST_CHANNEL_INDEX) {
+					if(moving_row->direction == 1) {
+						reachable[row] = (RowMask)(reachable[row] << 1) & ROW_MASK_ALL;
+					} else {
+						reachable[row] >>= 1;
+					}
+					carried_by[i - FIRST_CHANNEL_INDEX] += moving_row->direction;
+				}
+				pattern_death[i] = level_row_shift_mask(pattern_death[i], moving_row,
+						position[i], moving_row->direction, i >= FIRST_CHANNEL_INDEX);
+				reachable[row] &= ~pattern_death[i];
+			}
+			death[row] = pattern_death[i];
+			if(moving_row->fast_length) {
+				// The fast vehicle moves fast_speed times as far as the row.
+				// It hits a frog anywhere it passed over in the step - from 
+				// where it was to where it is now, in its direction.
+				uint8_t new_column = level_row_fast_column(moving_row, position[i], phase[i]);
+				fast_moves += level_phase_columns(phase[i], moving_row->fast_speed);
+				if(fast_moves + moving_row->fast_length > moving_row->width) {
+					fast_moves = moving_row->width - moving_row->fast_length;
+				}
+				reachable[row] &= ~level_span_mask(moving_row->direction == 1 ? 
+						fast_column : new_column, moving_row->fast_length + fast_moves, 
+						moving_row->width);
+				death[row] |= level_span_mask(new_column, moving_row->fast_length, 
+						moving_row->width);
+			}
+		}
+		if(step <= SOLVER_HISTORY_STEPS) {
+			for(row = START_ROW; row < RIVERBANK_ROW; row++) {
+				history[step][row] = reachable[row];
+			}
+			for(uint8_t channel = 0; channel < NUM_CHANNELS; channel++) {
+				carried[step][channel] = carried_by[channel];
+			}
+		}
+
+		// A frog in the row below the riverbank can jump into an open hole
+		RowMask new_holes = reachable[RIVERBANK_ROW - 1] & holes & ~holes_reached;
+		if(new_holes) {
+			for(uint8_t column = 0; column < BOARD_NUM_COLUMNS; column++) {
+				if((new_holes >> column) & 1) {
+					arrival_step[column] = step;
+				}
+			}
+			holes_reached |= new_holes;
+		}
+		if(holes_reached == holes || step == max_steps) {
+			break;
+		}
+
+		// Let the frog make one move (or stay where it is) - forward,
+		// backward, left or right. Moves off the sides are lost in the
+		// shifts and the mask. (We don't make the diagonal joystick moves,
+		// so a route can be followed with the buttons.)
+		for(row = START_ROW; row < RIVERBANK_ROW; row++) {
+			moved[row] = (reachable[row] | (RowMask)(reachable[row] << 1) | 
+					(reachable[row] >> 1)) & ROW_MASK_ALL;
+			if(row > START_ROW) {
+				moved[row] |= reachable[row-1];
+			}
+			if(row < RIVERBANK_ROW - 1) {
+				moved[row] |= reachable[row+1];
+			}
+		}
+		for(row = START_ROW; row < RIVERBANK_ROW; row++) {
+			reachable[row] = moved[row] & ~death[row];
+		}
+	}
+	last_step = step;
+	return holes_reached;
+}
+
+uint8_t solver_get_arrival_step(uint8_t column) {
+	return arrival_step[column];
+}
+
+// Return 1 if the frog could be in the given position at the start of the
+// given step
+static uint8_t was_reachable(uint8_t step, int8_t row, int8_t column) {
+	if(row < START_ROW || row >= RIVERBANK_ROW || column < 0 || column > LAST_COLUMN) {
+		return 0;
+	}
+	return (history[step][row] >> column) & 1;
+}
+
+// Work back from a position the frog could be in at the start of the
+// given step (within the history), filling in the moves made at each
+// earlier step. Returns the number of moves (the step), or 0 if no earlier
+// position leads to this one.
+static uint8_t trace_route(uint8_t step, int8_t row, int8_t column, uint8_t* moves) {
+	for(uint8_t s = step; s > 0; s--) {
+		// Undo any carrying by the logs to get the position the frog
+		// moved to at the previous step
+		if(row >= FIRST_RIVER_ROW && row < RIVERBANK_ROW) {
+			column -= carried[s][row - FIRST_RIVER_ROW];
+		}
+		// Find where it moved from
+		if(was_reachable(s-1, row, column)) {
+			moves[s-1] = SOLVER_MOVE_NONE;
+		} else if(was_reachable(s-1, row-1, column)) {
+			moves[s-1] = SOLVER_MOVE_FORWARD;
+			row--;
+		} else if(was_reachable(s-1, row+1, column)) {
+			moves[s-1] = SOLVER_MOVE_BACKWARD;
+			row++;
+		} else if(was_reachable(s-1, row, column-1)) {
+			moves[s-1] = SOLVER_MOVE_RIGHT;
+			column--;
+		} else if(was_reachable(s-1, row, column+1)) {
+			moves[s-1] = SOLVER_MOVE_LEFT;
+			column++;
+		} else {
+			return 0;
+		}
+	}
+	return step;
+}
+
+uint8_t solver_get_route_to_hole(uint8_t column, uint8_t* moves) {
+	uint8_t step = arrival_step[column];
+	if(step == SOLVER_UNREACHED || step > SOLVER_HISTORY_STEPS) {
+		return 0;
+	}
+	if(step > 0 && !trace_route(step, RIVERBANK_ROW - 1, column, moves)) {
+		return 0;
+	}
+	moves[step] = SOLVER_MOVE_FORWARD;
+	return step + 1;
+}
+
+uint8_t solver_get_best_route(uint8_t* moves) {
+	uint8_t best_column = SOLVER_UNREACHED;
+	uint8_t step;
+	for(uint8_t column = 0; column < BOARD_NUM_COLUMNS; column++) {
+		if(arrival_step[column] < SOLVER_UNREACHED &&
+				(best_column == SOLVER_UNREACHED ||
+				arrival_step[column] < arrival_step[best_column])) {
+			best_column = column;
+		}
+	}
+	if(best_column != SOLVER_UNREACHED && arrival_step[best_column] <= SOLVER_HISTORY_STEPS) {
+		return solver_get_route_to_hole(best_column, moves);
+	}
+
+	// No hole in reach - survive in the furthest row we can
+	step = last_step < SOLVER_HISTORY_STEPS ? last_step : SOLVER_HISTORY_STEPS;
+	for(int8_t row = RIVERBANK_ROW - 1; row >= START_ROW; row--) {
+		if(history[step][row]) {
+			int8_t column = 0;
+			while(!((history[step][row] >> column) & 1)) {
+				column++;
+			}
+			return trace_route(step, row, column, moves);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,104 @@
+/*
+ * solver.h
+ *
+ * Route finder for the frog. Given the state of a level (frog position,
+ * row positions, how far each row has moved towards its next scroll and
+ * the riverbank), the solver finds the fastest safe route to each open
+ * hole in the riverbank.
+ *
+ * The search is a breadth first search over time. Time is split into
+ * steps of SOLVER_STEP_TIME ms and the frog may make one move (or stay
+ * put) at the start of each step. The rows move at their own speeds in
+ * between, exactly as advance_moving_rows() moves them in the game.
+ * Because every row is a pattern that repeats every width columns, the
+ * state of the rows at any step is just their positions (modulo the
+ * width) - so rather than searching over whole game states we keep, for
+ * each step, the set of columns the frog could be in on each row (one
+ * bit mask per row). Each scroll then updates a row with a
+ * single shift, and every frog position is handled at once. The fast
+ * vehicle of a lane (see levels.h) is placed from the position and phase
+ * of its lane, and a frog anywhere it passed over during a step is lost.
+ *
+ * The sets for the first SOLVER_HISTORY_STEPS steps are kept so that the
+ * moves making up a route can be worked back from its end. Longer
+ * searches (e.g. checking that a level can be solved) only find which
+ * holes can be reached.
+ */
+
+#ifndef SOLVER_H_
+#define SOLVER_H_
+
+#include <stdint.h>
+#include "levels.h"
+#include "playfield.h"
+
+// Time (ms) between frog moves - about as fast as a player can press the
+// buttons
+#define SOLVER_STEP_TIME 100
+
+// Number of steps we can find routes for. The history takes 16 bytes per
+// step on the default board, so the board only looks a short way ahead.
+#ifdef __AVR__
+#define SOLVER_HISTORY_STEPS 16
+#else
+#define SOLVER_HISTORY_STEPS 180
+#endif
+
+// Moves
+#define SOLVER_MOVE_NONE 0
+#define SOLVER_MOVE_FORWARD 1
+#define SOLVER_MOVE_BACKWARD 2
+#define SOLVER_MOVE_LEFT 3
+#define SOLVER_MOVE_RIGHT 4
+
+// Returned by solver_get_arrival_step() for a hole that can't be reached
+#define SOLVER_UNREACHED 0xFF
+
+typedef struct {
+	int8_t frog_row;
+	int8_t frog_column;
+	RowMask riverbank_status;				// see game.c
+	uint8_t position[NUM_MOVING_ROWS];		// lane/log positions (see game.c)
+	uint32_t phase[NUM_MOVING_ROWS];		// part of a column moved since each
+											// row last scrolled (see game.h)
+	RowVelocity velocity[NUM_MOVING_ROWS];	// speed of each row
+} SolverState;
+
+// Set the state to the start of a level - the frog in its start position
+// and the rows at position 0, just scrolled
+void solver_start_of_level(const LevelDescriptor* level_data, uint8_t level,
+		SolverState* state);
+
+// Set the state from the game being played (see game.h)
+void solver_read_game_state(SolverState* state);
+
+// Move the state on by the given time (ms) - the rows move. The frog is
+// not moved.
+void solver_advance_state(const LevelDescriptor* level_data, SolverState* state,
+		uint16_t time);
+
+// Search up to max_steps steps ahead from the given state, stopping once
+// every open hole has been reached. Returns the open holes that can be
+// reached (1 bits, column 0 is the least significant bit).
+RowMask solver_search(const LevelDescriptor* level_data, const SolverState* state,
+		uint8_t max_steps);
+
+// The following use the results of the last search. The moves arrays
+// must have room for SOLVER_HISTORY_STEPS + 1 moves.
+// Return the step at which the frog can first jump into the hole in the
+// given column (0 for straight away), or SOLVER_UNREACHED.
+uint8_t solver_get_arrival_step(uint8_t column);
+
+// Fill in the moves of the fastest route to the hole in the given column.
+// The last move is the jump into the hole. Returns the number of moves, or
+// 0 if the hole can't be reached within SOLVER_HISTORY_STEPS steps (or the
+// route can't be worked back through the history).
+uint8_t solver_get_route_to_hole(uint8_t column, uint8_t* moves);
+
+// Fill in the moves of the fastest route to any hole. If no hole can be
+// reached, the route instead keeps the frog alive until the end of the
+// search (or SOLVER_HISTORY_STEPS), in the furthest row it can. Returns
+// the number of moves, or 0 if the frog can't survive.
+uint8_t solver_get_best_route(uint8_t* moves);
+
+#endif /* SOLVER_H_ */
@@ -12,9 +12,8 @@
 
 #include <stdint.h>
 #include <stdio.h>
-#include <avr/io.h>
-#include <avr/pgmspace.h>
 
+#include "hal.h"
 #include "terminalio.h"
 #include "timer0.h"
 
@@ -26,68 +25,12 @@ uint8_t sound_queue_length = 0;
 
 uint32_t time_paused = 0;
 
-// For a given frequency (Hz), return the clock period (in terms of the
-// number of clock cycles of a 1MHz clock)
-static uint16_t freq_to_clock_period(uint16_t freq) {
-	return (1000000UL / freq);	// UL makes the constant an unsigned long (32 bits)
-	// and ensures we do 32 bit arithmetic, not 16
-}
-
-// Return the width of a pulse (in clock cycles) given a duty cycle (%) and
-// the period of the clock (measured in clock cycles)
-static uint16_t duty_cycle_to_pulse_width(float dutycycle, uint16_t clockperiod) {
-	return (dutycycle * clockperiod) / 100;
-}
-
-static void play_sound(uint16_t freq) {
-	uint16_t clockperiod;
-	uint16_t pulsewidth;
-	float dutycycle;
-	
-	// Don't play sound if the game is muted (ie. switch 7 is in off position, 0)
-	if ((PIND & 0b10000000) == 0) {
-		return;
-	}
-	
-	// Determine the duty cycle based on the volume high/low switch (switch 6)
-	if ((PIND & 0b01000000) == 0) {
-		// Quieter output, lower duty cycle
-		dutycycle = 1;		// %
-	} else {
-		dutycycle = 5;
-	}
-	
-	clockperiod = freq_to_clock_period(freq);
-	pulsewidth = duty_cycle_to_pulse_width(dutycycle, clockperiod);
-	
-	// Set the maximum count value for timer/counter 1 to be one less than the clockperiod
-	OCR1A = clockperiod - 1;
-	
-	// Set the count compare value based on the pulse width. The value will be 1 less
-	// than the pulse width - unless the pulse width is 0.
-	if(pulsewidth == 0) {
-		OCR1B = 0;
-		} else {
-		OCR1B = pulsewidth - 1;
-	}
-	
-	// Set up timer/counter 1 for Fast PWM, counting from 0 to the value in OCR1A
-	// before reseting to 0. Count at 1MHz (CLK/8).
-	// Configure output OC1B to be clear on compare match and set on timer/counter
-	// overflow (non-inverting mode).
-	TCCR1A = (1 << COM1B1) | (0 <<COM1B0) | (1 <<WGM11) | (1 << WGM10);
-	TCCR1B = (1 << WGM13) | (1 << WGM12) | (0 << CS12) | (1 << CS11) | (0 << CS10);
-	
-	// Buzzer should now be buzzing
-}
-
 void init_sound_effects(void) {
-	// Make pin OC1B be an output (port D, pin 4)
-	DDRD = (1<<4);
+	hal_init_tone();
 }
 
 void stop_sound(void) {
-	TCCR1A = 0; // Reverts OC1A/OC1B to normal port operation, disconnecting the buzzer
+	hal_tone_stop();
 }
 
 uint8_t is_playing_sound(void) {
@@ -137,7 +80,7 @@ void update_sound_effects(uint8_t is_paused) {
 		} else {
 			// Play the next sound if it is scheduled to begin now
 			if (sound_queue_begin_times[0] <= current_time) {
-				play_sound(sound_queue_frequencies[0]);
+				hal_tone_start(sound_queue_frequencies[0]);
 			}
 		}
 	}
@@ -5,7 +5,65 @@
  */ 
 
 #include <avr/io.h>
+#include <avr/interrupt.h>
+#include "ledmatrix.h"
 #include "spi.h"
+#include "timer0.h"
+
+// The SS lines on port D used by the LED matrix panels after the first
+// (see set_slave_select()). Pins not wired to a panel are left alone.
+#if LEDMATRIX_NUM_PANELS > 2
+#define PORTD_SELECT_PINS ((1<<2)|(1<<3)|(1<<5))
+#elif LEDMATRIX_NUM_PANELS > 1
+#define PORTD_SELECT_PINS (1<<2)
+#else
+#define PORTD_SELECT_PINS 0
+#endif
+
+/* Circular buffer of bytes waiting to be sent. queue_head is the position
+ * of the next byte to send and bytes_in_queue the number of bytes waiting.
+ * transfer_in_progress is set while the SPI hardware is shifting out a
+ * byte (i.e. we're waiting for a transfer complete interrupt).
+ * An entry with its bit set in select_entries is not sent - it is the 
+ * number of the device to select before sending the entries after it.
+ * NOTE - SPI_QUEUE_SIZE can not be larger than 255 without changing the
+ * type of the variables below.
+ */
+#define SPI_QUEUE_SIZE 64
+static volatile uint8_t spi_queue[SPI_QUEUE_SIZE];
+static volatile uint8_t select_entries[SPI_QUEUE_SIZE / 8];
+static volatile uint8_t queue_head;
+static volatile uint8_t bytes_in_queue;
+static volatile uint8_t transfer_in_progress;
+
+// See spi_get_blocked_time()
+static uint32_t blocked_time;
+
+// Drive the SS line of the given device low and the others high. Device 0
+// is on port B, pin 4 and devices 1 to 3 on port D, pins 2, 3 and 5 (only
+// those with a panel are used).
+static void set_slave_select(uint8_t device) {
+	PORTB |= (1<<4);
+	PORTD |= PORTD_SELECT_PINS;
+	switch(device) {
+		case 0:
+			PORTB &= ~(1<<4);
+			break;
+#if LEDMATRIX_NUM_PANELS > 1
+		case 1:
+			PORTD &= ~(1<<2);
+			break;
+#endif
+#if LEDMATRIX_NUM_PANELS > 2
+		case 2:
+			PORTD &= ~(1<<3);
+			break;
+		case 3:
+			PORTD &= ~(1<<5);
+			break;
+#endif
+	}
+}
 
 void spi_setup_master(uint8_t clockdivider) {
 	// Set up SPI communication as a master
@@ -14,8 +72,13 @@ void spi_setup_master(uint8_t clockdivider) {
 	
 	DDRB |= (1<<4)|(1<<5)|(1<<7);
 	
-	// Set the slave select (SS) line high
+	// Set the slave select (SS) line high. The SS lines of the other 
+	// panels (port D, pins 2, 3 and 5 as needed) are outputs, also high.
 	PORTB |= (1<<4);
+#if LEDMATRIX_NUM_PANELS > 1
+	DDRD |= PORTD_SELECT_PINS;
+	PORTD |= PORTD_SELECT_PINS;
+#endif
 	
 	// Set up the SPI control registers SPCR and SPSR:
 	// - SPE bit = 1 (SPI is enabled)
@@ -50,20 +113,137 @@ void spi_setup_master(uint8_t clockdivider) {
 			break;
 	}
 	
-	// Take SS (slave select) line low
-	PORTB &= ~(1<<4);
+	// Enable the SPI transfer complete interrupt (used to send queued
+	// bytes)
+	SPCR0 |= (1<<SPIE0);
+	queue_head = 0;
+	bytes_in_queue = 0;
+	transfer_in_progress = 0;
+	
+	// Take SS (slave select) line of device 0 low
+	set_slave_select(0);
 }
 
-uint8_t spi_send_byte(uint8_t byte) {
-	// Write out the byte to the SPDR0 register. This will initiate
-	// the transfer. We then wait until the most significant byte of
-	// SPSR0 (SPIF0 bit) is set - this indicates that the transfer is
-	// complete. (The final read of SPSR0 followed by a read of SPDR0
-	// will cause the SPIF bit to be reset to 0. See page 224 of the 
-	// ATmega324A datasheet.)
-	SPDR0 = byte;
-	while((SPSR0 & (1<<SPIF0)) == 0) {
-		; // wait
+/* Start sending the next queued byte (if any), first acting on any device
+ * selects queued ahead of it. Must be called with interrupts disabled (or
+ * from the ISR).
+ */
+static void start_next_transfer(void) {
+	while(bytes_in_queue > 0) {
+		uint8_t entry = spi_queue[queue_head];
+		uint8_t is_select = select_entries[queue_head >> 3] & (1 << (queue_head & 7));
+		if(++queue_head == SPI_QUEUE_SIZE) {
+			queue_head = 0;
+		}
+		bytes_in_queue--;
+		if(is_select) {
+			// The previous byte has been sent, so it is safe to change
+			// devices now
+			set_slave_select(entry);
+		} else {
+			transfer_in_progress = 1;
+			SPDR0 = entry;
+			return;
+		}
+	}
+	transfer_in_progress = 0;
+}
+
+/* Called when interrupts are disabled and we need to wait for the queue. 
+ * We poll the SPIF0 flag and do the work of the ISR ourselves. 
+ */
+static void poll_transfer_complete(void) {
+	if(transfer_in_progress) {
+		while((SPSR0 & (1<<SPIF0)) == 0) {
+			; // wait
+		}
+		(void)SPDR0; // clears SPIF0
+		start_next_transfer();
 	}
+}
+
+/* Add an entry to the queue - a byte to send, or a device to select if
+ * is_select is non-zero.
+ */
+static void queue_entry(uint8_t entry, uint8_t is_select) {
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	
+	// Wait for space in the queue. The ISR will empty the queue if 
+	// interrupts are enabled - otherwise we have to do it ourselves.
+	if(bytes_in_queue >= SPI_QUEUE_SIZE) {
+		uint32_t wait_start = get_current_time_us();
+		while(bytes_in_queue >= SPI_QUEUE_SIZE) {
+			if(!interrupts_enabled) {
+				poll_transfer_complete();
+			}
+		}
+		blocked_time += get_current_time_us() - wait_start;
+	}
+	
+	cli();
+	uint8_t insert_pos = queue_head + bytes_in_queue;
+	if(insert_pos >= SPI_QUEUE_SIZE) {
+		insert_pos -= SPI_QUEUE_SIZE;
+	}
+	spi_queue[insert_pos] = entry;
+	if(is_select) {
+		select_entries[insert_pos >> 3] |= (1 << (insert_pos & 7));
+	} else {
+		select_entries[insert_pos >> 3] &= ~(1 << (insert_pos & 7));
+	}
+	bytes_in_queue++;
+	if(!transfer_in_progress) {
+		// SPI is idle - start it off. The interrupt will send the rest.
+		start_next_transfer();
+	}
+	if(interrupts_enabled) {
+		sei();
+	}
+}
+
+void spi_queue_byte(uint8_t byte) {
+	queue_entry(byte, 0);
+}
+
+void spi_queue_select(uint8_t device) {
+	if(device < SPI_NUM_DEVICES) {
+		queue_entry(device, 1);
+	}
+}
+
+void spi_flush(void) {
+	uint8_t interrupts_enabled = bit_is_set(SREG, SREG_I);
+	if(transfer_in_progress) {
+		uint32_t wait_start = get_current_time_us();
+		while(transfer_in_progress) {
+			if(!interrupts_enabled) {
+				poll_transfer_complete();
+			}
+		}
+		blocked_time += get_current_time_us() - wait_start;
+	}
+}
+
+uint32_t spi_get_blocked_time(void) {
+	return blocked_time;
+}
+
+void spi_reset_blocked_time(void) {
+	blocked_time = 0;
+}
+
+uint8_t spi_send_byte(uint8_t byte) {
+	// Queue the byte behind anything already waiting and wait until it
+	// has been sent. The received byte remains in SPDR0 until the next
+	// transfer starts.
+	spi_queue_byte(byte);
+	spi_flush();
 	return SPDR0;
+}
+
+/* SPI transfer complete interrupt - send the next queued byte. (The SPIF0
+ * flag is cleared by the hardware when this handler is executed.)
+ */
+ISR(SPI_STC_vect) {
+	start_next_transfer();
 }
\ No newline at end of file
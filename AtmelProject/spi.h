@@ -7,12 +7,40 @@
 #ifndef SPI_H_
 #define SPI_H_
 
+#include <stdint.h>
+
 // Set up SPI communication as a master.
 // clockdivider should be one of 2,4,8,16,32,64,128
 void spi_setup_master(uint8_t clockdivider);
 
 // Send and receive an SPI byte. This function will take at least 8 
-// cyles of the divided clock (i.e. will busy wait).
+// cyles of the divided clock (i.e. will busy wait). Any queued bytes
+// are sent first.
 uint8_t spi_send_byte(uint8_t byte);
 
+// Add a byte to the transmit queue and return immediately. Queued bytes
+// are sent in order by the SPI transfer complete interrupt. If the queue
+// is full this function waits for space. (If interrupts are disabled the
+// queue is drained by polling.)
+void spi_queue_byte(uint8_t byte);
+
+// Wait until all queued bytes have been sent.
+void spi_flush(void);
+
+// Up to SPI_NUM_DEVICES devices can share the bus, each with its own slave
+// select (SS) line. Device 0 uses the SS pin (port B, pin 4) and devices
+// 1 to 3 use port D pins 2, 3 and 5 - only the lines of the LED matrix
+// panels in use (LEDMATRIX_NUM_PANELS) are set up. Device 0 is selected
+// after spi_setup_master().
+// spi_queue_select() queues a change of device behind the bytes already
+// queued - those bytes still go to the previous device, and the bytes
+// queued after it go to the new one.
+#define SPI_NUM_DEVICES 4
+void spi_queue_select(uint8_t device);
+
+// Total time (us) spent waiting in spi_queue_byte() (queue full) and
+// spi_flush()
+uint32_t spi_get_blocked_time(void);
+void spi_reset_blocked_time(void);
+
 #endif /* SPI_H_ */
\ No newline at end of file
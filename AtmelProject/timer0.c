@@ -56,21 +56,40 @@ void init_timer0(void) {
 	TIFR0 &= (1<<OCF0A);
 }
 
+/* Read the clock tick count and the timer count within the current tick.
+ * Rather than disabling interrupts (so the interrupt can't fire when
+ * we've copied just a couple of bytes of the tick count) we read the
+ * tick count again and start over if it changed.
+ * If the compare match flag is set the tick interrupt is pending (we've
+ * been called with interrupts disabled) - the timer has already wrapped
+ * around to 0 but the tick count hasn't been incremented. The timer count
+ * is read before the flag so a small count means the match happened
+ * before we read it.
+ */
+static uint32_t read_clock(uint8_t* count) {
+	uint32_t ticks;
+	uint8_t pending;
+	do {
+		ticks = clockTicks;
+		*count = TCNT0;
+		pending = TIFR0 & (1<<OCF0A);
+	} while(ticks != clockTicks);
+	if(pending && *count < 62) {
+		ticks++;
+	}
+	return ticks;
+}
+
 uint32_t get_current_time(void) {
-	uint32_t returnValue;
+	uint8_t count;
+	return read_clock(&count);
+}
 
-	/* Disable interrupts so we can be sure that the interrupt
-	 * doesn't fire when we've copied just a couple of bytes
-	 * of the value. Interrupts are re-enabled if they were
-	 * enabled at the start.
-	 */
-	uint8_t interruptsOn = bit_is_set(SREG, SREG_I);
-	cli();
-	returnValue = clockTicks;
-	if(interruptsOn) {
-		sei();
-	}
-	return returnValue;
+uint32_t get_current_time_us(void) {
+	uint8_t count;
+	uint32_t ticks = read_clock(&count);
+	/* Each timer count is 64 clock cycles = 8us */
+	return ticks * 1000 + count * 8;
 }
 
 ISR(TIMER0_COMPA_vect) {
@@ -30,4 +30,13 @@ void init_timer0(void);
  */
 uint32_t get_current_time(void);
 
+/* Return the time in microseconds since the timer was initialised, to a
+ * resolution of 8us (one timer count). Wraps around after ~71 minutes, so
+ * only use it to time short intervals.
+ * Neither function disables interrupts. They can be called with
+ * interrupts disabled (or from an ISR) - a tick which is pending because
+ * of that is still counted.
+ */
+uint32_t get_current_time_us(void);
+
 #endif
\ No newline at end of file